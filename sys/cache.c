@@ -22,95 +22,360 @@
 #include "heap.h"
 #include "memory.h"
 #include "misc.h"
+#include "riscv.h"
 #include "string.h"
 #include "thread.h"
+#include "timer.h"
+#include "uio.h"
 
-#define FLUSH_IN_PROGRESS 1
-#define FLUSH_NOT_IN_PROGRESS 0
+#if CACHE_READAHEAD_MAX >= CACHE_IO_MAX
+#error "CACHE_READAHEAD_MAX >= CACHE_IO_MAX"
+#endif
+
+#if PAGE_SIZE / CACHE_BLKSZ >= 32
+#error "the block masks of a page sized line don't fit in an unsigned int"
+#endif
+
+#define CACHE_NOPOS ((unsigned long long)-1) // pos of a slot that holds no block
+#define CACHE_NOSLOT -1                      // end of a hash chain or of the free list
+#define CACHE_NOWRITER -1                    // writer of a slot that isn't held exclusively
+#define CACHE_AGAIN -1000                    // from cache_claim_slot(): cache->lock was let go, look the position up again
+
+// replacement queues (2Q). with CACHE_POLICY_LRU everything lives in CACHE_A1IN, which is then a plain LRU list
+#define CACHE_NOQUEUE -1 // queue of a slot that holds no block
+#define CACHE_A1IN 0     // probation: blocks referenced once. a long scan only ever churns this queue
+#define CACHE_AM 1       // protected: blocks referenced again after leaving probation, or hinted as metadata
+#define CACHE_NQUEUES 2
+#define CACHE_DIRTYQ 2 // not a queue: the recency list unpinned dirty slots of either queue sit on
+#define CACHE_NLISTS 3
+#define CACHE_A1IN_SHARE 4 // probation gives up slots first once it holds more than capacity / this
+#define CACHE_GHOST_SHARE 1 // probation remembers capacity / this evicted positions
 
 // INTERNAL TYPE DEFINITIONS
 //
+
+/// @brief bookkeeping for one slot (line) of a cache. slot i holds the line at blocks[i * line_blks].
+/// a line is the unit of lookup, replacement, pinning and holding. the masks track its blocks one by one
+struct cache_slot {
+    unsigned long long pos; // byte position of the line held in the slot, CACHE_NOPOS if empty
+    unsigned int valid; // mask of the blocks of the line that came in from disk, bit i for block i
+    unsigned int dirty; // mask of the blocks of the line that haven't been written back to disk yet
+    int pins; // threads holding or waiting for the slot. pinned slots are never evicted
+    int next; // next slot in the same hash bucket, or next free slot when the slot is on the free list
+    int queue; // replacement queue the block belongs to, CACHE_NOQUEUE if the slot is empty
+    int lru_prev; // recency list links. only unpinned slots that hold a block are on a list: their queue's if
+                  // clean, CACHE_DIRTYQ if dirty. dirty only changes while the slot is pinned, so it says which
+    int lru_next;
+    int prefetched; // 1 if the block was read ahead and nobody has asked for it yet
+    int writer; // thread holding the block exclusively, or CACHE_NOWRITER
+    int wcnt; // nesting depth of the exclusive hold, like the count of a recursive lock
+    int nreaders; // threads holding the block shared. nonzero only while writer is CACHE_NOWRITER
+    struct condition unlocked; // broadcast when the last reader or the writer lets go
+};
+
 struct cache {
-    int per_block_pos[CACHE_SIZE]; //NOTE: these field was changed to uint64_t from uint8 for obvious reasons// ok why the hell won't uint8_t compile here
-    int per_block_last_accessed[CACHE_SIZE];
-    struct lock per_block_locks[CACHE_SIZE];// indexes for cache_blocks correspond to indexes for cache_locks
+    struct serial statdev; // dev/cachestat<n>, reads back stats
+#if CACHE_RECORD_MAX > 0
+    struct serial tracedev; // dev/cachetrace<n>, reads back the access trace
+    unsigned long long * rec; // CACHE_RECORD_MAX entries from the page allocator, NULL if there was no room
+    int rec_len; // entries recorded
+    int rec_read; // entries read back through tracedev
+    int rec_on; // cleared when tracedev is opened, set again by FCNTL_RESET
+#endif
     struct storage* disk;
+    int capacity; // number of slots (lines)
+    int line_blks; // CACHE_BLKSZ blocks per line, 1 or PAGE_SIZE / CACHE_BLKSZ
+    int line_shift; // log2 of the line size in bytes
+    int nbuckets; // buckets in the position index, a power of two
+    unsigned int block_npages; // pages in the block arena
+    unsigned int meta_npages; // pages in the bookkeeping allocation that starts at slots
 
-    //struct condition flushed; //blocks while the cache is flushing, so that no threads can acquire any locks, but an still have a none adversarial position within the cache-modifying functions
-    //int flush_in_progress; //a "signal that goes high when the flush begins, so that any threads that try to get to acquring locks get stuck waiting on the above function
-                            //and EVENTUALLY RETURN in such a way that they were going to do something but never did it.
-    
-}; 
+    struct cache_block * blocks; // block arena, capacity * line_blks blocks, from the page allocator
+    struct cache_slot * slots; // capacity entries, from the page allocator
+    int * hash_heads; // nbuckets entries, first slot of each bucket of the position index
+    int * flush_order; // capacity entries, dirty slots sorted by position during a flush
 
-struct cache_block{char data[512];};
+    struct lock lock; // guards the index, the free list, the recency list, the pin counts and the slot holds
+    int free_head; // first slot on the free-slot list
+    int policy; // CACHE_POLICY_2Q or CACHE_POLICY_LRU
+    int lookup; // CACHE_LOOKUP_HASH or CACHE_LOOKUP_SCAN
+    int lru_head[CACHE_NLISTS]; // most recently released slot of each recency list
+    int lru_tail[CACHE_NLISTS]; // least recently released slot of each recency list
+    int qlen[CACHE_NQUEUES]; // slots in each queue, pinned or not
+    int a1in_max; // probation size past which its blocks are evicted before protected ones
 
-static struct cache_block cache_block_raw[CACHE_SIZE]; //a raw array of storage_fetched blocks to replace all the kmallocing.
-                                                       //for example, our cache_block:0, fetched at pos 512, will be placed at 0, and inside the cache instance, the per_block_pos[0] gets changed to 512
+    //positions recently evicted from probation (2Q's A1out). a miss on one of them goes straight to
+    //the protected queue, since the block has now been asked for twice
+    unsigned long long * ghost_pos; // nghost entries, a ring. CACHE_NOPOS marks an unused entry
+    int * ghost_next; // nghost entries, chains of ring entries in the same bucket
+    int * ghost_heads; // nbuckets entries, first ring entry of each bucket
+    int nghost;
+    int ghost_at; // ring entry the next evicted position overwrites
 
-/**
- * @brief finds the least recently used block on the list that ISN"T currently locked
- * @param cptr Pointer to the cache.
- * @return index of the lru+unlocked block on success, negative error code if error
- */
-int find_lru_unlocked(struct cache * cache){
+    struct lock flush_lock; // one cache_flush at a time, since they share flush_order
+    int ndirty; // slots with dirty set
+    int flush_kick; // set when the flusher should run again without waiting for its interval
+    struct cache_flush_params flush_params;
+    struct alarm flush_alarm; // the flusher sleeps on this between runs
+    int flush_tid; // the flusher thread. write-backs done by any other thread count as sync_stores
+    int flush_stop; // set by destroy_cache(). the flusher exits instead of sleeping again
+    int flush_running; // cleared by the flusher as it exits
+    struct condition flush_exited; // broadcast when flush_running is cleared
 
-    //reminder: higher last_accessed means more recently used
-    
-    //algorithm: we do the same thing as we were doing before, but this time, moving on to the next least recently used block if the first least recently used is locked
-    //          designed to behave just like the previous one in the case of one thread, and slightly different in the case of multiple threads
+    struct cache_block * io_buf; // CACHE_IO_MAX blocks, from the page allocator. multi-block requests go through here
+    struct lock io_lock; // one multi-block request at a time, since they share io_buf
+    unsigned long long ra_next; // position the next miss has to be at to continue the sequential stream
+    int ra_window; // blocks to read ahead on the next sequential miss
 
-    //4294967295 ru sure about this?
-    int lru_locked = 4294967295; //keeps the last_accessed value of an lru if the lru is locked. or if the second lru is also locked... or if the third lru is also also locked
+    //the range of the cache_store_direct in flight. misses in it wait while it's fenced, so nothing fills a line from
+    //the device while the device is being given new data for it. one store at a time has the range
+    int direct_tid; // thread doing the store, CACHE_NOWRITER if none
+    int direct_fenced; // 1 while misses in [direct_start, direct_end) have to wait
+    unsigned long long direct_start;
+    unsigned long long direct_end;
+    struct condition direct_done; // broadcast when the fence comes down or the range is let go
 
-    int num_lru_locked = 0;
-    while(num_lru_locked < CACHE_SIZE){ 
-        int lru = -1;
-        int last_access_greatest = -1; //variable to store the greatest last access of each iteration of the inner loop
+    struct cache_stats stats; // guarded by lock
+};
 
-        for (int i = 0; i < CACHE_SIZE; i++){ //the function of this inner loop is to find an lru candidate
-            if (!(cache->per_block_last_accessed[i] > last_access_greatest)) continue;         
-            if (!(cache->per_block_last_accessed[i] < lru_locked)) continue;
-            lru = i;
-            last_access_greatest = cache->per_block_last_accessed[i];
-        }
+struct cache_block{char data[CACHE_BLKSZ];};
 
-        if (!cache->per_block_locks[lru].owner) return lru; //at this point if the cache_block hasn't been locked down, just take it for eviction
+// INTERNAL FUNCTION DECLARATIONS
+//
 
-        lru_locked = cache->per_block_last_accessed[lru];
-        num_lru_locked++; //if the if statement didn't go through, increment the number of lrus we've gone through that have been locked
-    }
-    return 0;//if all 64 blocks are locked we've reached undefined behavior I guess I'll just return 0 so it can try to evict that
+static struct cache_block * cache_blk(struct cache* cache, int idx, int blk);
+static int cache_hash(struct cache* cache, unsigned long long pos);
+static int cache_lookup(struct cache* cache, unsigned long long pos);
+static void cache_index_insert(struct cache* cache, int idx, unsigned long long pos);
+static void cache_index_remove(struct cache* cache, int idx);
+static void cache_lru_unlink(struct cache* cache, int idx);
+static void cache_lru_push(struct cache* cache, int idx);
+static void cache_set_queue(struct cache* cache, int idx, int queue);
+static void cache_admit(struct cache* cache, int idx, unsigned long long pos, int flags);
+static int cache_ghost_take(struct cache* cache, unsigned long long pos);
+static void cache_ghost_add(struct cache* cache, unsigned long long pos);
+static void cache_pin(struct cache* cache, int idx);
+static void cache_unpin(struct cache* cache, int idx);
+static void cache_slot_lock(struct cache* cache, int idx, int shared);
+static void cache_slot_unlock(struct cache* cache, int idx);
+static void cache_evict(struct cache* cache, int idx);
+static int cache_claim_slot(struct cache* cache, int may_write);
+static long cache_fetch_run(struct cache* cache, unsigned long long pos, const int* batch, int n);
+static long cache_store_line(struct cache* cache, int idx);
+static int cache_flush_range(struct cache* cache, unsigned long long start, unsigned long long end);
+static void cache_direct_update(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len);
+static void cache_direct_settle(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len);
+static int cache_direct_fenced(struct cache* cache, unsigned long long line_pos);
+static void cache_direct_wait(struct cache* cache);
+static int cache_readahead(struct cache* cache, unsigned long long pos, int* batch);
+static void cache_sort_by_pos(struct cache* cache, int* idxs, int n);
+static void cache_kick_flusher(struct cache* cache);
+static void cache_flusher(struct cache* cache);
+static void cache_free(struct cache* cache);
+static int cache_stat_open(struct serial* ser);
+static void cache_stat_close(struct serial* ser);
+static int cache_stat_recv(struct serial* ser, void* buf, unsigned int bufsz);
+static int cache_stat_cntl(struct serial* ser, int op, void* arg);
+#if CACHE_RECORD_MAX > 0
+static void cache_record(struct cache* cache, unsigned long long rec);
+static int cache_trace_open(struct serial* ser);
+static void cache_trace_close(struct serial* ser);
+static int cache_trace_recv(struct serial* ser, void* buf, unsigned int bufsz);
+static int cache_trace_cntl(struct serial* ser, int op, void* arg);
+#else
+#define cache_record(cache, rec) do {} while (0)
+#endif
 
-}
+// INTERNAL GLOBAL VARIABLES AND CONSTANTS
+//
+
+static const struct serial_intf cache_stat_intf = {
+    .blksz = sizeof(struct cache_stats),
+    .open = &cache_stat_open,
+    .close = &cache_stat_close,
+    .recv = &cache_stat_recv,
+    .cntl = &cache_stat_cntl
+};
+
+#if CACHE_RECORD_MAX > 0
+static const struct serial_intf cache_trace_intf = {
+    .blksz = sizeof(unsigned long long),
+    .open = &cache_trace_open,
+    .close = &cache_trace_close,
+    .recv = &cache_trace_recv,
+    .cntl = &cache_trace_cntl
+};
+#endif
 
 /**
  * @brief Creates/initializes a cache with the passed backing storage device (disk) and makes it
- * available through cptr.
+ * available through cptr. The cache gets its own block arena and bookkeeping, both taken from the
+ * page allocator, so any number of caches can exist side by side. Each cache also gets a flusher
+ * thread that writes dirty blocks back in the background (see cache_set_flush_params()).
+ * Same as create_cache_mode() with CACHE_MODE_BLOCK.
  * @param disk Pointer to the backing storage device.
+ * @param capacity Number of CACHE_BLKSZ blocks the cache holds. 0 picks CACHE_CAPACITY.
  * @param cptr Pointer to the cache to create.
  * @return 0 on success, negative error code if error
  */
-int create_cache(struct storage* disk, struct cache** cptr) {
-    // FIXME
-    trace("%s(storage=%p,cptr=%p)", __func__, disk, cptr);
+int create_cache(struct storage* disk, unsigned int capacity, struct cache** cptr) {
+    return create_cache_mode(disk, capacity, CACHE_MODE_BLOCK, cptr);
+}
+
+/**
+ * @brief Creates a cache like create_cache(), picking the size of its lines. With CACHE_MODE_PAGE
+ * each line is one page of the arena, page aligned, and is read from the device with one request
+ * the first time any of its blocks is asked for. Blocks are still gotten and released CACHE_BLKSZ
+ * at a time, and only the blocks of a line that were released dirty are written back. Lookup,
+ * replacement and holds work on whole lines, so two blocks of the same line can't be held
+ * exclusively by different threads at once, and a thread holding one block of a line shared must
+ * not ask for another one exclusively.
+ * @param disk Pointer to the backing storage device.
+ * @param capacity Number of CACHE_BLKSZ blocks the cache holds, rounded up to whole lines. 0 picks
+ * CACHE_CAPACITY.
+ * @param mode CACHE_MODE_BLOCK or CACHE_MODE_PAGE
+ * @param cptr Pointer to the cache to create.
+ * @return 0 on success, negative error code if error
+ */
+int create_cache_mode(struct storage* disk, unsigned int capacity, int mode, struct cache** cptr) {
+    trace("%s(storage=%p,capacity=%u,mode=%d,cptr=%p)", __func__, disk, capacity, mode, cptr);
     if(!disk || !cptr) return -EINVAL;// if either argument is null, return immediately
+    if (mode != CACHE_MODE_BLOCK && mode != CACHE_MODE_PAGE) return -EINVAL;
+    if (capacity == 0) capacity = CACHE_CAPACITY;
 
     struct cache * c = kcalloc(1, sizeof(struct cache));
-    if(!c) return -EINVAL;// if c is NULL then kcalloc failed, so return error code
+    if(!c) return -ENOMEM;
+
+    c->line_blks = (mode == CACHE_MODE_PAGE) ? PAGE_SIZE / CACHE_BLKSZ : 1;
+    c->line_shift = 0;
+    while ((1UL << c->line_shift) < c->line_blks * CACHE_BLKSZ) c->line_shift++;
+    capacity = (capacity + c->line_blks - 1) / c->line_blks;
 
-    for (int i = 0; i < CACHE_SIZE; i++){
-        //c->blocks[i] = NULL; no need to do this anymore. 
-        c->per_block_pos[i] = -1; //-1 is used explicitly to say that the "block slot" in the cache hasn't been taken up yet
-        lock_init(&c->per_block_locks[i]);
+    c->capacity = capacity;
+    c->nbuckets = 1;
+    while (c->nbuckets < 2 * capacity) c->nbuckets *= 2; //about two buckets per slot keeps the chains short
+
+    unsigned int block_npages = ROUND_UP(capacity * c->line_blks * CACHE_BLKSZ, PAGE_SIZE) / PAGE_SIZE;
+    c->nghost = MAX(capacity / CACHE_GHOST_SHARE, 1);
+    unsigned int meta_npages = ROUND_UP(capacity * sizeof(struct cache_slot) + c->nghost * sizeof(unsigned long long)
+        + (2 * c->nbuckets + capacity + c->nghost) * sizeof(int), PAGE_SIZE) / PAGE_SIZE;
+    unsigned int io_npages = ROUND_UP(CACHE_IO_MAX * CACHE_BLKSZ, PAGE_SIZE) / PAGE_SIZE;
+    int tid;
+
+    c->block_npages = block_npages;
+    c->meta_npages = meta_npages;
+    c->blocks = alloc_phys_pages(block_npages);
+    if (!c->blocks){
+        kfree(c);
+        return -ENOMEM;
+    }
+    c->slots = alloc_phys_pages(meta_npages);
+    if (!c->slots){
+        free_phys_pages(c->blocks, block_npages);
+        kfree(c);
+        return -ENOMEM;
+    }
+    c->io_buf = alloc_phys_pages(io_npages);
+    if (!c->io_buf){
+        free_phys_pages(c->slots, meta_npages);
+        free_phys_pages(c->blocks, block_npages);
+        kfree(c);
+        return -ENOMEM;
     }
+    memset(c->slots, 0, meta_npages * PAGE_SIZE);
+    c->ghost_pos = (unsigned long long *)(c->slots + capacity);
+    c->hash_heads = (int *)(c->ghost_pos + c->nghost);
+    c->flush_order = c->hash_heads + c->nbuckets;
+    c->ghost_heads = c->flush_order + capacity;
+    c->ghost_next = c->ghost_heads + c->nbuckets;
 
+    for (int i = 0; i < c->nbuckets; i++) c->hash_heads[i] = CACHE_NOSLOT;
+    for (int i = 0; i < c->nbuckets; i++) c->ghost_heads[i] = CACHE_NOSLOT;
+    for (int i = 0; i < c->nghost; i++) c->ghost_pos[i] = CACHE_NOPOS;
+
+    for (int i = 0; i < capacity; i++){
+        c->slots[i].pos = CACHE_NOPOS; //CACHE_NOPOS is used explicitly to say that the "block slot" in the cache hasn't been taken up yet
+        c->slots[i].next = (i + 1 < capacity) ? i + 1 : CACHE_NOSLOT; //every slot starts out on the free list
+        c->slots[i].writer = CACHE_NOWRITER;
+        c->slots[i].queue = CACHE_NOQUEUE;
+        condition_init(&c->slots[i].unlocked, "cacheslot");
+    }
+    c->free_head = 0;
+    for (int q = 0; q < CACHE_NLISTS; q++){
+        c->lru_head[q] = CACHE_NOSLOT;
+        c->lru_tail[q] = CACHE_NOSLOT;
+    }
+    c->policy = CACHE_POLICY_2Q;
+    c->lookup = CACHE_LOOKUP_HASH;
+    c->a1in_max = MAX(capacity / CACHE_A1IN_SHARE, 1);
+    lock_init(&c->lock);
+    lock_init(&c->flush_lock);
+    lock_init(&c->io_lock);
+    c->ra_next = CACHE_NOPOS;
+    c->direct_tid = CACHE_NOWRITER;
+    condition_init(&c->direct_done, "cachedirect");
+    c->flush_params.interval_ms = CACHE_FLUSH_INTERVAL_MS;
+    c->flush_params.dirty_bg_pct = CACHE_DIRTY_BG_PCT;
+    alarm_init(&c->flush_alarm, "cacheflush");
+    condition_init(&c->flush_exited, "cacheflushexit");
+    c->flush_running = 1;
     c->disk = disk;
+
+    tid = spawn_thread("cacheflush", (void (*)(void))cache_flusher, c);
+    if (tid < 0){
+        cache_free(c);
+        return tid;
+    }
+    thread_detach(tid); //the flusher runs until destroy_cache() stops it
+    c->flush_tid = tid;
+
+    serial_init(&c->statdev, &cache_stat_intf);
+    register_device("cachestat", DEV_SERIAL, &c->statdev);
+#if CACHE_RECORD_MAX > 0
+    c->rec = alloc_phys_pages(ROUND_UP(CACHE_RECORD_MAX * sizeof(unsigned long long), PAGE_SIZE) / PAGE_SIZE);
+    c->rec_on = (c->rec != NULL);
+    serial_init(&c->tracedev, &cache_trace_intf);
+    register_device("cachetrace", DEV_SERIAL, &c->tracedev);
+#endif
+
     *cptr = c;
- 
-    // c->flush_in_progress = FLUSH_NOT_IN_PROGRESS;
-    // condition_init(&c->flushed, "cache_flushed");
     return 0;
-    
+}
+
+/**
+ * @brief Tears down a cache made by create_cache(): writes back every dirty block, stops the
+ * flusher thread, takes dev/cachestat<n> (and dev/cachetrace<n>) out of the device list and gives
+ * the cache's pages back. The backing device is left as it is. No block may be held, nothing may
+ * have the cache's devices open, and nothing may use the cache once this returns 0.
+ * @param cache Pointer to the cache to destroy.
+ * @return 0 on success, or the error of the final flush, in which case the cache is left as it was
+ */
+int destroy_cache(struct cache* cache) {
+    trace("%s(cache=%p)", __func__, cache);
+    int retval;
+
+    if (!cache) return -EINVAL;
+    retval = cache_flush(cache);
+    if (retval < 0) return retval;
+
+    lock_acquire(&cache->lock);
+    cache->flush_stop = 1;
+    cache_kick_flusher(cache);
+    while (cache->flush_running){
+        lock_release(&cache->lock);
+        //as in cache_slot_lock(), the flusher can't broadcast between the release and the wait
+        condition_wait(&cache->flush_exited);
+        lock_acquire(&cache->lock);
+    }
+    lock_release(&cache->lock);
+
+    unregister_device(&cache->statdev);
+#if CACHE_RECORD_MAX > 0
+    unregister_device(&cache->tracedev);
+    if (cache->rec) free_phys_pages(cache->rec, ROUND_UP(CACHE_RECORD_MAX * sizeof(unsigned long long), PAGE_SIZE) / PAGE_SIZE);
+#endif
+    cache_free(cache);
+    return 0;
 }
 
 /**
@@ -121,182 +386,1336 @@ int create_cache(struct storage* disk, struct cache** cptr) {
  * @param pptr Pointer to the block pointer read from the cache. Assume that CACHE_BLKSZ will always
  * be equal to the block size of the storage disk. Any replacement policy is permitted, as long as
  * your design meets the above specifications.
+ * The block is held exclusively, see cache_get_block_flags() for shared holds.
  * @return 0 on success, negative error code if error
  */
 int cache_get_block(struct cache* cache, unsigned long long pos, void** pptr) {
-    trace("%s(cache=%p, pos=%u,pptr=%p)\n", __func__, cache,pos, pptr);
-    int retval;
+    return cache_get_block_flags(cache, pos, 0, pptr);
+}
 
-    // while (cache->flush_in_progress) {
-    //     condition_wait(&cache->flushed);
-    // } //eventually resumes normally. we're just holding this guy because we don't want him to acquire any locks
+/**
+ * @brief Gets the block at pos from the cache, reading it from the backing device if needed.
+ * A miss that continues a sequential run of misses also reads the blocks after pos into the cache,
+ * in the same request to the device. See cache_readahead().
+ * @param cache Pointer to the cache.
+ * @param pos Position in the backing storage device, a multiple of CACHE_BLKSZ.
+ * @param flags 0 to hold the block exclusively. CACHE_SHARED to hold it for reading only, which
+ * lets other shared holders in at the same time. A shared block must be released with dirty == 0,
+ * and a thread that holds a block shared must not ask for it again exclusively (it would wait on
+ * itself). Asking again for a block the thread holds exclusively is fine in either mode.
+ * @param pptr Receives the block.
+ * @return 0 on success, negative error code if error
+ */
+int cache_get_block_flags(struct cache* cache, unsigned long long pos, int flags, void** pptr) {
+    trace("%s(cache=%p, pos=%u, flags=%d, pptr=%p)\n", __func__, cache, pos, flags, pptr);
+    int batch[CACHE_READAHEAD_MAX + 1]; // batch[0] is the slot for pos, the rest hold the read-ahead
+    unsigned long long line_pos = pos & ~((1ULL << cache->line_shift) - 1);
+    int blk = (pos - line_pos) / CACHE_BLKSZ; // block of the line that pos is in
+    int nra;
+    long nfilled;
+    int idx;
 
     if (pos % CACHE_BLKSZ) return -EINVAL;
-    trace("address of cache_block_raw:%p\n",cache_block_raw);
 
-    for (int i = 0; i < CACHE_SIZE; i++){
-        //if (cache->per_block_pos[i] != -1 && cache->per_block_pos[i] == pos){
-        if (cache->per_block_pos[i] == pos){ //don't need to check for -1... pos can only be positive
-            trace("block found in cache at index %d\n", i);
-            trace("lock acquired for block %d\n", i);
-            lock_acquire(&cache->per_block_locks[i]);
+    for (;;) {
+        lock_acquire(&cache->lock);
+        idx = cache_lookup(cache, line_pos);
 
-            *pptr = &cache_block_raw[i].data;
-            return 0;
-        }
-    }
+        if (idx != CACHE_NOSLOT){
+            trace("block found in cache at index %d\n", idx);
+            cache->stats.hits++;
+            if (cache->slots[idx].prefetched){
+                cache->slots[idx].prefetched = 0;
+                cache->stats.prefetch_hits++;
+            }
+            cache_pin(cache, idx); //the pin keeps the slot from being evicted while we wait for it
+            if ((flags & CACHE_META) && cache->policy == CACHE_POLICY_2Q) cache_set_queue(cache, idx, CACHE_AM);
+            cache_slot_lock(cache, idx, flags & CACHE_SHARED);
 
-    int avail_slot = 0;
-    while (avail_slot < CACHE_SIZE){
-        if (cache->per_block_pos[avail_slot] == -1){
-            break;
+            //the slot can change under a pin if the thread filling it failed the fetch, or if it was being
+            //written back to make room and was given up once that was done
+            if (cache->slots[idx].pos == line_pos){
+                if (!(cache->slots[idx].valid & (1U << blk))){ //the line ran past the end of the disk
+                    cache_slot_unlock(cache, idx);
+                    cache_unpin(cache, idx);
+                    lock_release(&cache->lock);
+                    return -EIO;
+                }
+                cache_record(cache, pos | (unsigned long long)flags << CACHE_REC_FLAGS_SHIFT);
+                lock_release(&cache->lock);
+                *pptr = cache_blk(cache, idx, blk);
+                return 0;
+            }
+            cache_slot_unlock(cache, idx);
+            cache_unpin(cache, idx);
+            lock_release(&cache->lock);
+            continue;
         }
-        avail_slot++;
-    }
-
-    if (avail_slot < CACHE_SIZE){
-        trace("there was a slot available on the cache table at index %d\n", avail_slot);
-        trace("lock acquired for block %d\n", avail_slot);
-        lock_acquire(&cache->per_block_locks[avail_slot]);
-
-        //cache->blocks[avail_slot] = kcalloc(1, sizeof(struct cache_block));//NOT KCALLOCING ANYMORE!!!
-        cache->per_block_pos[avail_slot] = pos;
-        
-        retval = storage_fetch(cache->disk, pos, &cache_block_raw[avail_slot], CACHE_BLKSZ);
-        // trace("storage_fetch returned %d\n", retval);
-        // trace("first bytes: %02x %02x %02x %02x\n", 
-        // cache_block_raw[avail_slot].data[0],
-        // cache_block_raw[avail_slot].data[1], 
-        // cache_block_raw[avail_slot].data[2],
-        // cache_block_raw[avail_slot].data[3]);
-        if (retval<0) {
-            trace("storage_fetch failed \n");
-            lock_release(&cache->per_block_locks[avail_slot]); //forgot to release this lock in prior commits
-            return retval;
+
+        //the device is getting new data for the line from cache_store_direct(), so what we'd read now may be stale
+        if (cache_direct_fenced(cache, line_pos)){
+            cache_direct_wait(cache);
+            lock_release(&cache->lock);
+            continue;
         }
 
-        *pptr = &cache_block_raw[avail_slot];
-        trace("blockptr = %p\n", *pptr);
-        return 0;
+        idx = cache_claim_slot(cache, 1);
+        if (idx == CACHE_AGAIN){
+            lock_release(&cache->lock);
+            continue;
+        }
+        cache->stats.misses++;
+        if (idx < 0){
+            lock_release(&cache->lock);
+            return idx;
+        }
+        break;
     }
-    
 
-    trace("there were no slots available. evict block \n");
+    //keeping the slot locked while it sits in the index makes any other thread that looks up pos
+    //wait until the fetch below is done. the same goes for the read-ahead slots
+    cache_admit(cache, idx, line_pos, flags);
+    batch[0] = idx;
+    nra = cache_readahead(cache, line_pos, batch);
+    lock_release(&cache->lock);
 
-    //lru search: this loop searches for the least recently used block and stores its index in lru
-    int lru = -1;
-    int lru_max = -1;
-    for (int i = 0; i < CACHE_SIZE; i++){        
-        if (!(cache->per_block_last_accessed[i] > lru_max)) continue;
+    nfilled = cache_fetch_run(cache, line_pos, batch, nra + 1);
 
-        lru = i;
-        lru_max = cache->per_block_last_accessed[i];
+    lock_acquire(&cache->lock);
+    if (nfilled > 0) cache->slots[idx].valid = (1U << MIN(nfilled, cache->line_blks)) - 1;
+    //backwards, so the block right after pos ends up the most recently used of the batch
+    for (int i = nra; i > 0; i--){
+        if (i < nfilled){
+            cache->slots[batch[i]].valid = 1;
+            cache->stats.prefetched++;
+        } else { //the device came up short. forget the block instead of caching garbage
+            cache->slots[batch[i]].prefetched = 0;
+            cache_index_remove(cache, batch[i]);
+        }
+        cache_slot_unlock(cache, batch[i]);
+        cache_unpin(cache, batch[i]);
     }
 
-    //int lru = find_lru_unlocked(cache);
-    
-    trace("lock acquired for block %d\n", avail_slot);
-    lock_acquire(&cache->per_block_locks[lru]); //this has to come after the lru search. because we need the lru index
-
-    
-    retval = storage_fetch(cache->disk, pos, &cache_block_raw[lru], CACHE_BLKSZ);
-    if (retval<0) {
+    if (nfilled <= blk) {
         trace("storage_fetch failed \n");
-        lock_release(&cache->per_block_locks[avail_slot]); //forgot to release this lock in prior commits
-        return retval;
+        cache_index_remove(cache, idx);
+        cache_slot_unlock(cache, idx);
+        cache_unpin(cache, idx); //goes back on the free list once any waiters have seen it's empty
+        lock_release(&cache->lock);
+        return (nfilled < 0) ? nfilled : -EIO;
     }
+    //the fill needed the block to ourselves. a shared holder lets other readers in from here on
+    if (flags & CACHE_SHARED){
+        cache_slot_unlock(cache, idx);
+        cache_slot_lock(cache, idx, 1); //nobody else can hold it yet, so this never waits
+    }
+    cache_record(cache, pos | (unsigned long long)flags << CACHE_REC_FLAGS_SHIFT);
+    lock_release(&cache->lock);
 
-    cache->per_block_pos[lru] = pos;
-    *pptr = &cache_block_raw[lru];
+    *pptr = cache_blk(cache, idx, blk);
+    trace("blockptr = %p\n", *pptr);
     return 0;
 }
 
+/**
+ * @brief Gets n consecutive blocks starting at pos, like n calls to cache_get_block(), except that
+ * each run of blocks that aren't cached is read from the backing device with a single request (of
+ * up to CACHE_IO_MAX blocks, or a whole line in a CACHE_MODE_PAGE cache). The blocks are locked in
+ * ascending position order.
+ * @param cache Pointer to the cache.
+ * @param pos Position of the first block. Must be a multiple of CACHE_BLKSZ.
+ * @param n Number of blocks. All n stay pinned until released, so n should be small next to the
+ * capacity of the cache.
+ * @param flags As for cache_get_block_flags(), applied to every block.
+ * @param ptrs ptrs[i] receives the block at pos + i * CACHE_BLKSZ.
+ * @return 0 on success, negative error code if error (in which case no block is held)
+ */
+int cache_get_blocks(struct cache* cache, unsigned long long pos, int n, int flags, void** ptrs) {
+    trace("%s(cache=%p, pos=%llu, n=%d, flags=%d, ptrs=%p)\n", __func__, cache, pos, n, flags, ptrs);
+    int batch[CACHE_IO_MAX];
+    int nheld = 0;
+    long nfilled;
+    int retval;
+
+    if (pos % CACHE_BLKSZ || n < 0) return -EINVAL;
+
+    while (nheld < n){
+        unsigned long long run_pos = pos + (unsigned long long)nheld * CACHE_BLKSZ;
+        int nrun = 0;
+
+        //a page line brings in all its blocks with one request anyway, so only block lines batch misses. a block
+        //fenced off by cache_store_direct() is waited for there too
+        lock_acquire(&cache->lock);
+        if (cache->line_blks > 1 || cache_lookup(cache, run_pos) != CACHE_NOSLOT || cache_direct_fenced(cache, run_pos)){
+            lock_release(&cache->lock);
+            retval = cache_get_block_flags(cache, run_pos, flags, &ptrs[nheld]);
+            if (retval < 0) goto fail;
+            nheld++;
+            continue;
+        }
+
+        //claim slots for the blocks from run_pos up to the next one that is already cached
+        while (nrun < CACHE_IO_MAX && nheld + nrun < n){
+            unsigned long long blk_pos = run_pos + (unsigned long long)nrun * CACHE_BLKSZ;
+            int idx;
+
+            if (nrun > 0 && (cache_lookup(cache, blk_pos) != CACHE_NOSLOT || cache_direct_fenced(cache, blk_pos))) break;
+            idx = cache_claim_slot(cache, 1);
+            if (idx < 0){
+                //fetch what we have, the next pass reports the error if it persists. after CACHE_AGAIN that may
+                //be nothing: the lock was let go, so the next pass has to look run_pos up again
+                if (nrun > 0 || idx == CACHE_AGAIN) break;
+                lock_release(&cache->lock);
+                retval = idx;
+                goto fail;
+            }
+            cache->stats.misses++;
+            cache_admit(cache, idx, blk_pos, flags);
+            batch[nrun++] = idx;
+        }
+        lock_release(&cache->lock);
+        if (nrun == 0) continue;
+
+        nfilled = cache_fetch_run(cache, run_pos, batch, nrun);
+
+        lock_acquire(&cache->lock);
+        for (int i = 0; i < nrun; i++){
+            if (i < nfilled){
+                cache->slots[batch[i]].valid = 1;
+                ptrs[nheld + i] = cache_blk(cache, batch[i], 0);
+                cache_record(cache, (run_pos + i * CACHE_BLKSZ) | (unsigned long long)flags << CACHE_REC_FLAGS_SHIFT);
+                if (flags & CACHE_SHARED){ //same as the end of cache_get_block_flags()
+                    cache_slot_unlock(cache, batch[i]);
+                    cache_slot_lock(cache, batch[i], 1);
+                }
+            } else {
+                cache_index_remove(cache, batch[i]);
+                cache_slot_unlock(cache, batch[i]);
+                cache_unpin(cache, batch[i]);
+            }
+        }
+        lock_release(&cache->lock);
+
+        if (nfilled < nrun){
+            retval = (nfilled < 0) ? nfilled : -EIO;
+            if (nfilled > 0) nheld += nfilled;
+            goto fail;
+        }
+        nheld += nrun;
+    }
+    return 0;
+
+fail:
+    cache_release_blocks(cache, ptrs, nheld, 0);
+    return retval;
+}
+
 /**
  * @brief Releases a block previously obtained from cache_get_block().
  * @param cache Pointer to the cache.
  * @param pblk Pointer to a block that was made available in cache_get_block() (which means that
  * pblk == *pptr for some pptr).
  * @param dirty Indicates whether the block has been modified (1) or not (0). If dirty == 1, the
- * block has been written to. If dirty == 0, the block has not been written to.
+ * block has been written to. If dirty == 0, the block has not been written to. Only an exclusive
+ * holder may pass 1.
  * @return 0 on success, negative error code if error
  */
 void cache_release_block(struct cache* cache, void* pblk, int dirty) {
     trace("%s(cache=%p,pblk=%p, dirty=%d)", __func__, cache, pblk, dirty);
 
-    // while (cache->flush_in_progress) {
-    //     condition_wait(&cache->flushed);
-    // } //eventually resumes normally. we're just holding this guy because we don't want him to acquire any locks
-      
-      
-    //struct cache_block * block = (void *)pblk - offsetof(struct cache_block, data);//pretty bad honestly
-    
-
-    //finds finds the index of the block we'd like to release
-    // int curr_block_index = 0;
-    // for (int i=0; i < CACHE_SIZE; i++){
-    //     if ((struct cache_block *)&cache_block_raw + i== (struct cache_block *)&pblk){
-    //         curr_block_index = i;
-    //         break;
-    //     }
-    // }
-    //int curr_block_index = (int)((char)cache_block_raw - pblk)/CACHE_BLKSZ;
-    //size_t curr_block_index = cache_block_raw - (struct cache_block *)pblk; //cache_block_raw decays to its type;
-    int curr_block_index = (struct cache_block *) pblk - cache_block_raw;
+    int arena_index = (struct cache_block *) pblk - cache->blocks;
+    assert(0 <= arena_index && arena_index < cache->capacity * cache->line_blks);
+    int curr_block_index = arena_index / cache->line_blks; //the slot, which holds the whole line
+    unsigned int blk_bit = 1U << (arena_index % cache->line_blks);
     trace("curr_block_index: %d\n", curr_block_index);
-    
-    lock_acquire(&cache->per_block_locks[curr_block_index]);
 
-    if (dirty ==1){ //store here
-        int retval = storage_store(cache->disk, cache->per_block_pos[curr_block_index], pblk, CACHE_BLKSZ);
-        if (retval < 0) return;//I still cannot just allow the block to be unlocked. just return and thats enough. not that this was NOT a change
+    lock_acquire(&cache->lock);
+    assert(!dirty || cache->slots[curr_block_index].writer == running_thread());
+    //nothing is written here. the block goes back to disk when it is flushed or evicted
+    if (dirty && !(cache->slots[curr_block_index].dirty & blk_bit)){
+        if (!cache->slots[curr_block_index].dirty){
+            cache->ndirty++;
+            if (cache->ndirty * 100 >= cache->capacity * cache->flush_params.dirty_bg_pct)
+                cache_kick_flusher(cache);
+        }
+        cache->slots[curr_block_index].dirty |= blk_bit;
+    }
+    cache_record(cache, (cache->slots[curr_block_index].pos + (arena_index % cache->line_blks) * CACHE_BLKSZ)
+        | CACHE_REC_RELEASE | (dirty ? CACHE_REC_DIRTY : 0));
+    cache_slot_unlock(cache, curr_block_index);
+    cache_unpin(cache, curr_block_index); //last one out moves it to the front of the recency list
+    lock_release(&cache->lock);
+}
+
+/**
+ * @brief Releases n blocks obtained from cache_get_blocks() (or cache_get_block()).
+ * @param cache Pointer to the cache.
+ * @param ptrs The blocks to release.
+ * @param n Number of blocks in ptrs.
+ * @param dirty Whether the blocks have been modified, as for cache_release_block(). Applies to all n.
+ */
+void cache_release_blocks(struct cache* cache, void** ptrs, int n, int dirty) {
+    for (int i = 0; i < n; i++) cache_release_block(cache, ptrs[i], dirty);
+}
+
+/**
+ * @brief Flushes the cache to the backing device. Every block that is dirty when the flush starts
+ * is written back, in ascending position order, with runs of adjacent blocks going to the device as
+ * one request (the dirty blocks of a page line go as one request of their own). The flush only holds blocks shared, so readers carry on while their block is written.
+ * Blocks held exclusively by another thread are written once that thread releases them.
+ * @param cache Pointer to the cache to flush
+ * @return 0 on success, error code if error (the first error seen; the flush still tries every block)
+ */
+int cache_flush(struct cache* cache) {
+    trace("%s(cache=%p)", __func__, cache);
+    return cache_flush_range(cache, 0, CACHE_NOPOS);
+}
+
+/**
+ * @brief Brings n consecutive blocks starting at pos into the cache ahead of use, each run that
+ * isn't cached yet with a single request, as cache_get_blocks() does. Stops after half the
+ * capacity of the cache, so warming a large region can't push out everything else.
+ * @param cache Pointer to the cache.
+ * @param pos Position of the first block, a multiple of CACHE_BLKSZ.
+ * @param n Number of blocks.
+ * @param flags CACHE_META to keep the blocks resident through scans (see cache_get_block_flags()),
+ * or 0.
+ * @return Number of blocks brought in (or found cached), or negative error code if the first
+ * request failed
+ */
+long cache_prefetch(struct cache* cache, unsigned long long pos, unsigned long n, int flags) {
+    trace("%s(cache=%p, pos=%llu, n=%lu, flags=%d)\n", __func__, cache, pos, n, flags);
+    unsigned long limit = (unsigned long)cache->capacity * cache->line_blks / 2;
+    void * blks[CACHE_IO_MAX];
+    unsigned long ndone = 0;
+    int retval;
+
+    if (pos % CACHE_BLKSZ) return -EINVAL;
+
+    n = MIN(n, limit);
+    while (ndone < n){
+        int nrun = MIN(n - ndone, CACHE_IO_MAX);
+        retval = cache_get_blocks(cache, pos + ndone * CACHE_BLKSZ, nrun, CACHE_SHARED | flags, blks);
+        if (retval < 0) return (ndone > 0) ? (long)ndone : retval;
+        cache_release_blocks(cache, blks, nrun, 0);
+        ndone += nrun;
     }
+    return ndone;
+}
 
+/**
+ * @brief Reads len bytes at pos from the backing device straight into buf, past the cache: the
+ * cache neither looks for the blocks nor keeps them, so a large read costs no copy through the
+ * arena and evicts nothing. Dirty cached blocks in the range are written back first, so the read
+ * sees every write released before the call. buf gets the device's DMA directly if it lies in
+ * physical RAM (kernel memory), and goes through the cache's staging buffer a few blocks at a time
+ * otherwise (a user address, say).
+ * @param cache Pointer to the cache.
+ * @param pos Position in the backing storage device, a multiple of CACHE_BLKSZ.
+ * @param buf Buffer to read into.
+ * @param len Bytes to read, a multiple of CACHE_BLKSZ.
+ * @return Bytes read (short at the end of the device), or negative error code if error
+ */
+long cache_fetch_direct(struct cache* cache, unsigned long long pos, void* buf, unsigned long len) {
+    trace("%s(cache=%p, pos=%llu, buf=%p, len=%lu)\n", __func__, cache, pos, buf, len);
+    unsigned long nread = 0;
+    unsigned long long t0;
+    long retval;
 
-    trace("updateing last access for block index %d\n", curr_block_index);
-    int blockindex = 0;
-    while(blockindex < CACHE_SIZE)
-    {
-        if(cache->per_block_last_accessed[blockindex] != -1 && curr_block_index != blockindex)
-        {
-            cache->per_block_last_accessed[blockindex]++;
+    if (pos % CACHE_BLKSZ || len % CACHE_BLKSZ) return -EINVAL;
+
+    retval = cache_flush_range(cache, pos, pos + len);
+    if (retval < 0) return retval;
+
+    t0 = rdtime();
+    if (RAM_START_PMA <= (uintptr_t)buf && (uintptr_t)buf + len <= RAM_END_PMA){
+        retval = storage_fetch(cache->disk, pos, buf, len);
+        nread = (retval < 0) ? 0 : retval;
+    } else {
+        lock_acquire(&cache->io_lock);
+        while (nread < len){
+            unsigned long n = MIN(len - nread, CACHE_IO_MAX * CACHE_BLKSZ);
+            retval = storage_fetch(cache->disk, pos + nread, cache->io_buf, n);
+            if (retval <= 0) break;
+            memcpy((char *)buf + nread, cache->io_buf, retval);
+            nread += retval;
+            if ((unsigned long)retval < n) break; //end of the device
         }
-        blockindex++;
+        lock_release(&cache->io_lock);
     }
-    cache->per_block_last_accessed[curr_block_index]= 0;
 
-    lock_release(&cache->per_block_locks[curr_block_index]);
-    //trace("between the first and second release\n");
-    lock_release(&cache->per_block_locks[curr_block_index]);
- 
+    lock_acquire(&cache->lock);
+    cache->stats.fetch_ticks += rdtime() - t0;
+    cache->stats.direct += nread / CACHE_BLKSZ;
+    lock_release(&cache->lock);
+    if (retval < 0 && nread == 0) return retval;
+    return nread;
 }
 
 /**
- * @brief Flushes the cache to the backing device
- * @param cache Pointer to the cache to flush
- * @return 0 on success, error code if error
+ * @brief Writes len bytes from buf to the backing device at pos, past the cache, the way
+ * cache_fetch_direct() reads: one storage request straight from buf if it lies in physical RAM,
+ * through the staging buffer a few blocks at a time otherwise. Blocks of the range that are cached
+ * get the new data too (after any holder lets go), and stay dirty until the device has it, so
+ * nothing reads, evicts or writes back the old contents while the store is in flight. Blocks that
+ * aren't cached are left that way, and a miss on one waits for the store to finish rather than
+ * read what the device had before. One direct store runs at a time.
+ * @param cache Pointer to the cache.
+ * @param pos Position in the backing storage device, a multiple of CACHE_BLKSZ.
+ * @param buf Buffer to write from.
+ * @param len Bytes to write, a multiple of CACHE_BLKSZ.
+ * @return Bytes written (short at the end of the device), or negative error code if error
  */
-int cache_flush(struct cache* cache) {
+long cache_store_direct(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len) {
+    trace("%s(cache=%p, pos=%llu, buf=%p, len=%lu)\n", __func__, cache, pos, buf, len);
+    unsigned long nwritten = 0;
+    long retval = 0;
+
+    if (pos % CACHE_BLKSZ || len % CACHE_BLKSZ) return -EINVAL;
+
+    cache_direct_update(cache, pos, buf, len);
+
+    if (RAM_START_PMA <= (uintptr_t)buf && (uintptr_t)buf + len <= RAM_END_PMA)
+        nwritten = retval = storage_store(cache->disk, pos, buf, len);
+    else {
+        lock_acquire(&cache->io_lock);
+        while (nwritten < len){
+            unsigned long n = MIN(len - nwritten, CACHE_IO_MAX * CACHE_BLKSZ);
+            memcpy(cache->io_buf, (const char *)buf + nwritten, n);
+            retval = storage_store(cache->disk, pos + nwritten, cache->io_buf, n);
+            if (retval <= 0) break;
+            nwritten += retval;
+            if ((unsigned long)retval < n) break; //end of the device
+        }
+        lock_release(&cache->io_lock);
+    }
+    if (retval < 0) nwritten = 0; //the cached copies stay dirty and get there on their own
+
+    //the cached copies that still match what went to the device don't have to be written again
+    cache_direct_settle(cache, pos, buf, nwritten);
+
+    lock_acquire(&cache->lock);
+    cache->stats.direct_stores += nwritten / CACHE_BLKSZ;
+    lock_release(&cache->lock);
+    if (retval < 0) return retval;
+    return nwritten;
+}
+
+/**
+ * @brief Changes how the background flusher of a cache behaves. Takes effect right away.
+ * @param cache Pointer to the cache.
+ * @param params interval_ms is the time between background flushes, 0 to only flush on demand.
+ * dirty_bg_pct is the percentage of the cache that has to be dirty to start a flush before the
+ * interval is up.
+ * @return 0 on success, -EINVAL if a percentage is over 100
+ */
+int cache_set_flush_params(struct cache* cache, const struct cache_flush_params* params) {
+    if (params->dirty_bg_pct > 100) return -EINVAL;
+
+    lock_acquire(&cache->lock);
+    cache->flush_params = *params;
+    cache_kick_flusher(cache); //so it picks up the new interval now rather than after the old one
+    lock_release(&cache->lock);
+    return 0;
+}
+
+/**
+ * @brief Reads the current flusher settings of a cache, see cache_set_flush_params().
+ * @param cache Pointer to the cache.
+ * @param params Filled in with the current settings.
+ */
+void cache_get_flush_params(struct cache* cache, struct cache_flush_params* params) {
+    lock_acquire(&cache->lock);
+    *params = cache->flush_params;
+    lock_release(&cache->lock);
+}
+
+/**
+ * @brief Picks the replacement policy of a cache. CACHE_POLICY_2Q (the default) splits the cache
+ * into a probation queue for blocks that have been asked for once and a protected queue for blocks
+ * asked for again (or with CACHE_META), and evicts from probation first, so a long sequential read
+ * only recycles probation slots. CACHE_POLICY_LRU evicts the least recently used block, whatever it
+ * is. Blocks already cached keep their place when the policy changes.
+ * @param cache Pointer to the cache.
+ * @param policy CACHE_POLICY_2Q or CACHE_POLICY_LRU
+ * @return 0 on success, -EINVAL for an unknown policy
+ */
+int cache_set_policy(struct cache* cache, int policy) {
+    if (policy != CACHE_POLICY_2Q && policy != CACHE_POLICY_LRU) return -EINVAL;
+
+    lock_acquire(&cache->lock);
+    cache->policy = policy;
+    lock_release(&cache->lock);
+    return 0;
+}
+
+/**
+ * @brief Picks how a cache finds the line a position is in. CACHE_LOOKUP_HASH (the default) walks one
+ * chain of the position index. CACHE_LOOKUP_SCAN compares the position with every slot, the way the
+ * cache did before it had the index, and is only there so benchmarks can time the two side by side.
+ * The index is kept up to date either way, so the lookup can be changed at any time.
+ * @param cache Pointer to the cache.
+ * @param lookup CACHE_LOOKUP_HASH or CACHE_LOOKUP_SCAN
+ * @return 0 on success, -EINVAL for an unknown lookup
+ */
+int cache_set_lookup(struct cache* cache, int lookup) {
+    if (lookup != CACHE_LOOKUP_HASH && lookup != CACHE_LOOKUP_SCAN) return -EINVAL;
+
+    lock_acquire(&cache->lock);
+    cache->lookup = lookup;
+    lock_release(&cache->lock);
+    return 0;
+}
+
+/**
+ * @brief Copies out the counters the cache keeps about itself. Hit rate is hits / (hits + misses),
+ * and prefetch_wasted / prefetched is the share of read-ahead that was thrown away unused.
+ * @param cache Pointer to the cache.
+ * @param stats Filled in with a snapshot of the counters.
+ */
+void cache_get_stats(struct cache* cache, struct cache_stats* stats) {
+    lock_acquire(&cache->lock);
+    *stats = cache->stats;
+    lock_release(&cache->lock);
+}
+
+/**
+ * @brief Zeroes the counters the cache keeps about itself, so a workload can be measured on its own.
+ * @param cache Pointer to the cache.
+ */
+void cache_reset_stats(struct cache* cache) {
+    lock_acquire(&cache->lock);
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    lock_release(&cache->lock);
+}
+
+// INTERNAL FUNCTION DEFINITIONS
+//
+
+/**
+ * @brief gets the flusher to run as soon as it can, without waiting out its interval. caller must
+ * hold cache->lock
+ * @param cache Pointer to the cache.
+ */
+static void cache_kick_flusher(struct cache* cache){
+    cache->flush_kick = 1;
+    alarm_wake(&cache->flush_alarm); //no-op if the flusher is busy, it sees flush_kick when done
+}
+
+/**
+ * @brief body of the flusher thread of a cache. sleeps for the flush interval (or until kicked)
+ * and then flushes the cache, until destroy_cache() stops it
+ * @param cache Pointer to the cache.
+ */
+static void cache_flusher(struct cache* cache){
+    for (;;){
+        unsigned long interval_ms;
+        int kicked;
+        int ndirty;
+
+        lock_acquire(&cache->lock);
+        if (cache->flush_stop){
+            cache->flush_running = 0;
+            condition_broadcast(&cache->flush_exited);
+            lock_release(&cache->lock);
+            return;
+        }
+        kicked = cache->flush_kick;
+        interval_ms = cache->flush_params.interval_ms;
+        lock_release(&cache->lock);
+
+        if (!kicked){
+            alarm_reset(&cache->flush_alarm);
+            if (interval_ms) alarm_sleep_ms(&cache->flush_alarm, interval_ms);
+            else alarm_sleep(&cache->flush_alarm, UINT64_MAX); //until kicked
+        }
+
+        //kicks from here on mean there's more to write than this flush will see
+        lock_acquire(&cache->lock);
+        cache->flush_kick = 0;
+        ndirty = cache->ndirty;
+        lock_release(&cache->lock);
+
+        if (ndirty > 0 && cache_flush(cache) < 0)
+            trace("background flush of cache %p failed\n", cache);
+    }
+}
+
+/**
+ * @brief gives back the pages and the struct of a cache whose flusher isn't running
+ * @param cache Pointer to the cache.
+ */
+static void cache_free(struct cache* cache){
+    free_phys_pages(cache->io_buf, ROUND_UP(CACHE_IO_MAX * CACHE_BLKSZ, PAGE_SIZE) / PAGE_SIZE);
+    free_phys_pages(cache->slots, cache->meta_npages);
+    free_phys_pages(cache->blocks, cache->block_npages);
+    kfree(cache);
+}
+
+/**
+ * @brief finds a block in the arena
+ * @param cache Pointer to the cache.
+ * @param idx slot holding the line
+ * @param blk block of the line
+ * @return the block
+ */
+static struct cache_block * cache_blk(struct cache* cache, int idx, int blk){
+    return &cache->blocks[idx * cache->line_blks + blk];
+}
+
+/**
+ * @brief hashes a line position to its bucket in the position index
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the block
+ * @return bucket index
+ */
+static int cache_hash(struct cache* cache, unsigned long long pos){
+    //consecutive lines land in consecutive buckets, which is the common access pattern for ktfs
+    return (pos >> cache->line_shift) & (cache->nbuckets - 1);
+}
+
+/**
+ * @brief finds the slot holding the block at pos. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the block
+ * @return slot index, or CACHE_NOSLOT if the block isn't cached
+ */
+static int cache_lookup(struct cache* cache, unsigned long long pos){
+    int idx;
+
+    if (cache->lookup == CACHE_LOOKUP_SCAN){ //every slot in the index has its position set, and no other does
+        for (idx = 0; idx < cache->capacity; idx++)
+            if (cache->slots[idx].pos == pos) return idx;
+        return CACHE_NOSLOT;
+    }
+
+    idx = cache->hash_heads[cache_hash(cache, pos)];
+    while (idx != CACHE_NOSLOT && cache->slots[idx].pos != pos)
+        idx = cache->slots[idx].next;
+    return idx;
+}
+
+/**
+ * @brief makes slot idx the holder of the block at pos. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to insert. must not currently be in the index
+ * @param pos byte position of the block
+ */
+static void cache_index_insert(struct cache* cache, int idx, unsigned long long pos){
+    int bucket = cache_hash(cache, pos);
+    cache->slots[idx].pos = pos;
+    cache->slots[idx].next = cache->hash_heads[bucket];
+    cache->hash_heads[bucket] = idx;
+}
+
+/**
+ * @brief unlinks slot idx from the position index and marks it empty. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to remove
+ */
+static void cache_index_remove(struct cache* cache, int idx){
+    int * link = &cache->hash_heads[cache_hash(cache, cache->slots[idx].pos)];
+    while (*link != CACHE_NOSLOT && *link != idx)
+        link = &cache->slots[*link].next;
+    if (*link == idx) *link = cache->slots[idx].next;
+
+    cache->slots[idx].pos = CACHE_NOPOS;
+    cache->slots[idx].valid = 0;
+    cache->slots[idx].next = CACHE_NOSLOT;
+    cache_set_queue(cache, idx, CACHE_NOQUEUE);
+}
+
+/**
+ * @brief takes slot idx off its recency list. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to unlink. must be on the list
+ */
+static void cache_lru_unlink(struct cache* cache, int idx){
+    int q = cache->slots[idx].dirty ? CACHE_DIRTYQ : cache->slots[idx].queue;
+    int prev = cache->slots[idx].lru_prev;
+    int next = cache->slots[idx].lru_next;
+
+    if (prev != CACHE_NOSLOT) cache->slots[prev].lru_next = next;
+    else cache->lru_head[q] = next;
+    if (next != CACHE_NOSLOT) cache->slots[next].lru_prev = prev;
+    else cache->lru_tail[q] = prev;
+}
+
+/**
+ * @brief puts slot idx at the most recently used end of the recency list of its queue, or of the
+ * dirty list if it's dirty. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to push. must not be on the list
+ */
+static void cache_lru_push(struct cache* cache, int idx){
+    int q = cache->slots[idx].dirty ? CACHE_DIRTYQ : cache->slots[idx].queue;
+
+    cache->slots[idx].lru_prev = CACHE_NOSLOT;
+    cache->slots[idx].lru_next = cache->lru_head[q];
+    if (cache->lru_head[q] != CACHE_NOSLOT) cache->slots[cache->lru_head[q]].lru_prev = idx;
+    else cache->lru_tail[q] = idx;
+    cache->lru_head[q] = idx;
+}
+
+/**
+ * @brief moves a slot that is off the recency lists (pinned, or empty) to another queue. caller
+ * must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to move
+ * @param queue CACHE_A1IN, CACHE_AM or CACHE_NOQUEUE
+ */
+static void cache_set_queue(struct cache* cache, int idx, int queue){
+    if (cache->slots[idx].queue != CACHE_NOQUEUE) cache->qlen[cache->slots[idx].queue]--;
+    if (queue != CACHE_NOQUEUE) cache->qlen[queue]++;
+    cache->slots[idx].queue = queue;
+}
+
+/**
+ * @brief makes slot idx the holder of the block at pos, which was just asked for, and picks its
+ * queue: protected if it comes with CACHE_META or was evicted from probation not long ago,
+ * probation otherwise. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot that will hold the block. must not be in the index
+ * @param pos byte position of the block
+ * @param flags flags the block was asked for with
+ */
+static void cache_admit(struct cache* cache, int idx, unsigned long long pos, int flags){
+    int queue = CACHE_A1IN;
+
+    if (cache->policy == CACHE_POLICY_2Q && ((flags & CACHE_META) || cache_ghost_take(cache, pos)))
+        queue = CACHE_AM;
+    cache_index_insert(cache, idx, pos);
+    cache_set_queue(cache, idx, queue);
+}
+
+/**
+ * @brief looks for pos among the positions recently evicted from probation and forgets it if
+ * found. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the block
+ * @return 1 if pos was there, 0 if not
+ */
+static int cache_ghost_take(struct cache* cache, unsigned long long pos){
+    int * link = &cache->ghost_heads[cache_hash(cache, pos)];
+
+    while (*link != CACHE_NOSLOT && cache->ghost_pos[*link] != pos)
+        link = &cache->ghost_next[*link];
+    if (*link == CACHE_NOSLOT) return 0;
+
+    cache->ghost_pos[*link] = CACHE_NOPOS;
+    *link = cache->ghost_next[*link];
+    return 1;
+}
+
+/**
+ * @brief remembers a position evicted from probation, forgetting the oldest one remembered if
+ * the ring is full. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the evicted block
+ */
+static void cache_ghost_add(struct cache* cache, unsigned long long pos){
+    int g = cache->ghost_at;
+    int bucket;
+
+    //read-ahead doesn't consult the ring, so pos may already be in it. a position must only be
+    //there once, or taking the oldest entry's position below could unlink a newer entry instead
+    cache_ghost_take(cache, pos);
+    if (cache->ghost_pos[g] != CACHE_NOPOS) cache_ghost_take(cache, cache->ghost_pos[g]);
+
+    bucket = cache_hash(cache, pos);
+    cache->ghost_pos[g] = pos;
+    cache->ghost_next[g] = cache->ghost_heads[bucket];
+    cache->ghost_heads[bucket] = g;
+    cache->ghost_at = (g + 1) % cache->nghost;
+}
+
+/**
+ * @brief adds a pin to a slot that holds a block, taking it off the recency list if it was
+ * unpinned. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to pin
+ */
+static void cache_pin(struct cache* cache, int idx){
+    if (cache->slots[idx].pins++ == 0) cache_lru_unlink(cache, idx);
+}
+
+/**
+ * @brief drops a pin. when the last pin goes the slot becomes the most recently used block, or
+ * goes back on the free list if it no longer holds a block. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to unpin
+ */
+static void cache_unpin(struct cache* cache, int idx){
+    if (--cache->slots[idx].pins > 0) return;
+
+    if (cache->slots[idx].pos == CACHE_NOPOS){
+        cache->slots[idx].next = cache->free_head;
+        cache->free_head = idx;
+    } else cache_lru_push(cache, idx);
+}
+
+/**
+ * @brief takes a pinned slot that's being reused out of the index. if its block was read ahead
+ * and never asked for, the read-ahead was wasted and the window shrinks. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot being evicted
+ */
+static void cache_evict(struct cache* cache, int idx){
+    if (cache->slots[idx].prefetched){
+        cache->slots[idx].prefetched = 0;
+        cache->stats.prefetch_wasted++;
+        cache->ra_window /= 2;
+    }
+    cache->stats.evictions++;
+    if (cache->policy == CACHE_POLICY_2Q && cache->slots[idx].queue == CACHE_A1IN)
+        cache_ghost_add(cache, cache->slots[idx].pos);
+    cache_index_remove(cache, idx);
+}
+
+/**
+ * @brief takes a slot to put a new block in: a free one, or else the least recently used clean one
+ * of the queue that gives up slots first (probation while it's over a1in_max, protected otherwise;
+ * the other queue if that one has nothing clean). dirty blocks sit on a list of their own, so either
+ * way the slot comes straight off a list tail. only if every unpinned block is dirty, and the caller
+ * allows it, is the oldest one written back, with cache->lock let go for the write. the slot stays
+ * in the index, held, until the device has the data, so nobody re-fetches the old contents. it goes
+ * to the free list afterwards and CACHE_AGAIN tells the caller to look its position up again, since
+ * another thread may have brought it in meanwhile. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param may_write 0 for read-ahead, which is only a guess and so never pays for a write-back
+ * @return slot index, pinned, held exclusively and out of the index, CACHE_AGAIN, or negative error code
+ */
+static int cache_claim_slot(struct cache* cache, int may_write){
+    int retval;
+    int q;
+    int idx = cache->free_head;
+
+    if (idx != CACHE_NOSLOT){
+        trace("there was a slot available on the cache table at index %d\n", idx);
+        cache->free_head = cache->slots[idx].next;
+        cache->slots[idx].pins = 1;
+        cache_slot_lock(cache, idx, 0); //nobody holds a free slot, so this never waits
+        return idx;
+    }
+
+    q = CACHE_A1IN;
+    if (cache->policy == CACHE_POLICY_2Q && cache->qlen[CACHE_A1IN] <= cache->a1in_max) q = CACHE_AM;
+    if (cache->lru_tail[q] == CACHE_NOSLOT) q = !q;
+
+    //everything on the recency lists is unpinned, and the queues' lists only have clean blocks
+    idx = cache->lru_tail[q];
+    if (idx != CACHE_NOSLOT){
+        trace("there were no slots available. evict block %d\n", idx);
+        cache_pin(cache, idx);
+        cache_slot_lock(cache, idx, 0); //nobody holds an unpinned slot, so this never waits
+        cache_evict(cache, idx);
+        return idx;
+    }
+
+    //dirty blocks are the flusher's job. when they're all that's left, the caller pays for one
+    idx = cache->lru_tail[CACHE_DIRTYQ];
+    if (idx == CACHE_NOSLOT) return -EBUSY; //every block is pinned
+    if (!may_write) return -EBUSY;
+    cache_kick_flusher(cache);
+    cache_pin(cache, idx);
+    cache_slot_lock(cache, idx, 0); //nobody holds an unpinned slot, so this never waits
+    lock_release(&cache->lock);
+
+    retval = cache_store_line(cache, idx);
+
+    lock_acquire(&cache->lock);
+    if (retval >= 0){
+        cache->slots[idx].dirty = 0;
+        cache->ndirty--;
+        cache->stats.writebacks++;
+        cache->stats.sync_stores++; //the caller is waiting on this to get its block
+        cache_evict(cache, idx);
+    }
+    cache_slot_unlock(cache, idx);
+    cache_unpin(cache, idx); //to the free list, unless somebody who waited on it still has it pinned
+    return (retval < 0) ? retval : CACHE_AGAIN;
+}
+
+/**
+ * @brief writes back the dirty lines that overlap [start, end), as cache_flush() does for the
+ * whole cache
+ * @param cache Pointer to the cache.
+ * @param start byte position where the range starts
+ * @param end byte position just past the range
+ * @return 0 on success, error code if error (the first error seen)
+ */
+static int cache_flush_range(struct cache* cache, unsigned long long start, unsigned long long end){
+    unsigned long long line_size = 1ULL << cache->line_shift;
+    unsigned long long line_pos;
+    int sync = (running_thread() != cache->flush_tid);
+    int run[CACHE_IO_MAX];
+    int ndirty = 0;
+    int result = 0;
+    int retval;
+    int next = 0;
+
+    lock_acquire(&cache->flush_lock);
+
+    lock_acquire(&cache->lock);
+    for (int i = 0; i < cache->capacity; i++){
+        if (cache->slots[i].dirty && cache->slots[i].pos < end && cache->slots[i].pos + line_size > start)
+            cache->flush_order[ndirty++] = i;
+    }
+    cache_sort_by_pos(cache, cache->flush_order, ndirty);
+    lock_release(&cache->lock);
+
+    //cache->lock isn't held while writing, the pins and the shared holds are enough to keep the
+    //blocks where they are. only one run is pinned at a time so a flush never makes the cache look full
+    while (next < ndirty){
+        int idx = cache->flush_order[next++];
+        int n = 1;
+
+        lock_acquire(&cache->lock);
+        if (!cache->slots[idx].dirty){ //evicted (and written) since we looked
+            lock_release(&cache->lock);
+            continue;
+        }
+        line_pos = cache->slots[idx].pos;
+        cache_pin(cache, idx);
+
+        //the first block of a run is the only one we wait for. waiting on another block while
+        //holding this one could deadlock with a thread that holds both
+        cache_slot_lock(cache, idx, 1);
+        if (!cache->slots[idx].dirty || cache->slots[idx].pos != line_pos){ //cache_claim_slot wrote it back while we waited
+            cache_slot_unlock(cache, idx);
+            cache_unpin(cache, idx);
+            lock_release(&cache->lock);
+            continue;
+        }
+        run[0] = idx;
+
+        //page lines are written one at a time, straight from the arena
+        while (cache->line_blks == 1 && n < CACHE_IO_MAX && next < ndirty){
+            int adj = cache->flush_order[next];
+            if (cache->slots[adj].pos != cache->slots[idx].pos + n * CACHE_BLKSZ) break;
+            if (!cache->slots[adj].dirty || cache->slots[adj].writer != CACHE_NOWRITER) break;
+            cache_pin(cache, adj);
+            cache_slot_lock(cache, adj, 1); //no writer, so this never waits
+            run[n++] = adj;
+            next++;
+        }
+        lock_release(&cache->lock);
+
+        if (n == 1) retval = cache_store_line(cache, idx);
+        else {
+            lock_acquire(&cache->io_lock);
+            for (int i = 0; i < n; i++) memcpy(&cache->io_buf[i], cache_blk(cache, run[i], 0), CACHE_BLKSZ);
+            retval = storage_store(cache->disk, cache->slots[idx].pos, cache->io_buf, n * CACHE_BLKSZ);
+            lock_release(&cache->io_lock);
+        }
+        if (retval < 0 && result == 0) result = retval;
+
+        lock_acquire(&cache->lock);
+        if (retval >= 0){
+            cache->stats.writebacks += n;
+            if (sync) cache->stats.sync_stores += n;
+        }
+        for (int i = 0; i < n; i++){
+            if (retval >= 0 && cache->slots[run[i]].dirty){
+                cache->slots[run[i]].dirty = 0;
+                cache->ndirty--;
+            }
+            cache_slot_unlock(cache, run[i]);
+            cache_unpin(cache, run[i]);
+        }
+        lock_release(&cache->lock);
+    }
+
+    lock_release(&cache->flush_lock);
+    return result;
+}
+
+/**
+ * @brief takes the direct store range for [pos, pos + len), fences it off, and copies the blocks of
+ * it that are cached from buf, for cache_store_direct(). each line is held exclusively while it's
+ * written, one at a time, and its blocks are marked valid and dirty. the fence comes down while we
+ * wait for a holder, since the holder may be waiting on the fence for another block of the range,
+ * and the walk starts over once it's back up to catch the lines that were filled meanwhile. the
+ * fence stays up when this returns, until cache_direct_settle()
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the first block
+ * @param buf the new contents of the range
+ * @param len bytes in the range, a multiple of CACHE_BLKSZ
+ */
+static void cache_direct_update(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len){
+    unsigned long long line_size = 1ULL << cache->line_shift;
+    int tid = running_thread();
+    unsigned long long lpos;
+
+    lock_acquire(&cache->lock);
+    while (cache->direct_tid != CACHE_NOWRITER) cache_direct_wait(cache);
+    cache->direct_tid = tid;
+    cache->direct_start = pos;
+    cache->direct_end = pos + len;
+
+restart:
+    cache->direct_fenced = 1;
+    for (lpos = pos & ~(line_size - 1); lpos < pos + len; lpos += line_size){
+        int idx = cache_lookup(cache, lpos);
+        int first = (MAX(lpos, pos) - lpos) / CACHE_BLKSZ;
+        int last = (MIN(lpos + line_size, pos + len) - lpos) / CACHE_BLKSZ;
+        int held;
+
+        if (idx == CACHE_NOSLOT) continue;
+        held = (cache->slots[idx].writer != CACHE_NOWRITER && cache->slots[idx].writer != tid) || cache->slots[idx].nreaders > 0;
+        if (held){
+            cache->direct_fenced = 0;
+            condition_broadcast(&cache->direct_done);
+        }
+        cache_pin(cache, idx);
+        cache_slot_lock(cache, idx, 0);
+        if (cache->slots[idx].pos == lpos){ //a fetch that failed while we waited drops the line
+            if (!cache->slots[idx].dirty) cache->ndirty++;
+            for (int b = first; b < last; b++){
+                memcpy(cache_blk(cache, idx, b), (const char *)buf + (lpos - pos) + b * CACHE_BLKSZ, CACHE_BLKSZ);
+                cache->slots[idx].valid |= 1U << b;
+                cache->slots[idx].dirty |= 1U << b;
+            }
+        }
+        cache_slot_unlock(cache, idx);
+        cache_unpin(cache, idx);
+        if (held) goto restart;
+    }
+    lock_release(&cache->lock);
+}
+
+/**
+ * @brief marks the blocks of [pos, pos + len) that cache_direct_update() dirtied clean again, now
+ * that the device has them, and lets go of the direct store range. a block somebody holds
+ * exclusively, or that has changed since, stays dirty
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the first block
+ * @param buf what was written to the device
+ * @param len bytes the device took, a multiple of CACHE_BLKSZ
+ */
+static void cache_direct_settle(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len){
+    unsigned long long line_size = 1ULL << cache->line_shift;
+
+    lock_acquire(&cache->lock);
+    for (unsigned long long lpos = pos & ~(line_size - 1); lpos < pos + len; lpos += line_size){
+        int idx = cache_lookup(cache, lpos);
+        int first = (MAX(lpos, pos) - lpos) / CACHE_BLKSZ;
+        int last = (MIN(lpos + line_size, pos + len) - lpos) / CACHE_BLKSZ;
 
-    for (int i = 0; i < CACHE_SIZE; i++){
-        lock_acquire(&cache->per_block_locks[i]);
-        lock_release(&cache->per_block_locks[i]);
-    }
-
-    // while (cache->flush_in_progress) { //imagine trying to throw a wrench in here lol
-    //     condition_wait(&cache->flushed);
-    // } //eventually resumes normally. we're just holding this guy because we don't want him to acquire any locks
-    // //or should this be an early return with a negative value????????
-    //
-    // cache->flush_in_progress = FLUSH_IN_PROGRESS;
-    //
-    // for (int i = 0; i < CACHE_SIZE; i++){
-    //     lock_acquire(&cache->cache_locks[i]);
-    // }
-    // for (int i = 0; i < CACHE_SIZE; i++){
-    //     lock_release(&cache->cache_locks[CACHE_SIZE - i]);
-    // }
-    //
-    // cache->flush_in_progress = FLUSH_NOT_IN_PROGRESS;
-    // condition_broadcast(&cache->flushed);
+        if (idx == CACHE_NOSLOT || !cache->slots[idx].dirty || cache->slots[idx].writer != CACHE_NOWRITER) continue;
+        cache_pin(cache, idx); //the pin keeps it off the recency lists while its dirty mask changes
+        for (int b = first; b < last; b++){
+            if (memcmp(cache_blk(cache, idx, b), (const char *)buf + (lpos - pos) + b * CACHE_BLKSZ, CACHE_BLKSZ) == 0)
+                cache->slots[idx].dirty &= ~(1U << b);
+        }
+        if (!cache->slots[idx].dirty) cache->ndirty--;
+        cache_unpin(cache, idx);
+    }
+    cache->direct_fenced = 0;
+    cache->direct_tid = CACHE_NOWRITER;
+    condition_broadcast(&cache->direct_done);
+    lock_release(&cache->lock);
+}
+
+/**
+ * @brief tells whether a miss on the line at line_pos has to wait for cache_store_direct(). caller
+ * must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param line_pos byte position of the line
+ * @return 1 if the line overlaps the fenced range, 0 if not
+ */
+static int cache_direct_fenced(struct cache* cache, unsigned long long line_pos){
+    return cache->direct_fenced && line_pos < cache->direct_end
+        && line_pos + (1ULL << cache->line_shift) > cache->direct_start;
+}
+
+/**
+ * @brief waits for the direct store range to change: its fence to come down, or the range to be let
+ * go. drops cache->lock while waiting. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ */
+static void cache_direct_wait(struct cache* cache){
+    lock_release(&cache->lock);
+    condition_wait(&cache->direct_done); //as in cache_slot_lock(), the broadcast can't slip in before this
+    lock_acquire(&cache->lock);
+}
+
+/**
+ * @brief reads n consecutive lines starting at pos into the given slots with one storage_fetch.
+ * runs of more than one line only happen with block lines. caller must hold the slot locks and must
+ * not hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the first line
+ * @param batch the n slots to fill, in position order
+ * @param n number of lines, at most CACHE_IO_MAX
+ * @return number of blocks filled (fewer than asked for if the device came up short), or negative error code
+ */
+static long cache_fetch_run(struct cache* cache, unsigned long long pos, const int* batch, int n){
+    unsigned long long t0 = rdtime();
+    long retval;
+
+    if (n == 1) retval = storage_fetch(cache->disk, pos, cache_blk(cache, batch[0], 0), cache->line_blks * CACHE_BLKSZ);
+    else {
+        //the slots of a run are scattered over the arena, so the device fills io_buf and we copy out
+        lock_acquire(&cache->io_lock);
+        retval = storage_fetch(cache->disk, pos, cache->io_buf, n * CACHE_BLKSZ);
+        for (int i = 0; i < n && (i + 1) * CACHE_BLKSZ <= retval; i++)
+            memcpy(cache_blk(cache, batch[i], 0), &cache->io_buf[i], CACHE_BLKSZ);
+        lock_release(&cache->io_lock);
+    }
+
+    lock_acquire(&cache->lock);
+    cache->stats.fetch_ticks += rdtime() - t0;
+    lock_release(&cache->lock);
+    return (retval < 0) ? retval : retval / CACHE_BLKSZ;
+}
+
+/**
+ * @brief writes the dirty blocks of a line back to disk, as one request that spans them straight
+ * from the arena. clean blocks in between go along (they are valid, so that's harmless). does not
+ * clear the dirty mask. caller must hold the line (a shared hold is enough, since only an exclusive
+ * holder dirties a line) and may hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot holding the line
+ * @return bytes written, or negative error code
+ */
+static long cache_store_line(struct cache* cache, int idx){
+    unsigned int dirty = cache->slots[idx].dirty;
+    int first = 0;
+    int last = cache->line_blks - 1;
+
+    while (!(dirty & (1U << first))) first++;
+    while (!(dirty & (1U << last))) last--;
+    return storage_store(cache->disk, cache->slots[idx].pos + first * CACHE_BLKSZ,
+        cache_blk(cache, idx, first), (last - first + 1) * CACHE_BLKSZ);
+}
+
+/**
+ * @brief decides how far to read ahead of a miss at pos and claims slots for the blocks after it.
+ * a miss right where the last one (plus its read-ahead) ended continues a sequential stream and
+ * doubles the window, up to CACHE_READAHEAD_MAX; any other miss ends the stream. the window is also
+ * halved whenever a read-ahead block is evicted unused. caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param pos byte position of the missed block
+ * @param batch batch[1..] receives the claimed slots, each pinned, locked and in the index
+ * @return number of blocks to read ahead. the run stops early at a block that is already cached,
+ * at the end of the disk, or when no clean slot is left
+ */
+static int cache_readahead(struct cache* cache, unsigned long long pos, int* batch){
+    int n = 0;
+
+    if (cache->line_blks > 1) return 0; //a page line is a read-ahead of its own
+
+    if (pos != cache->ra_next) cache->ra_window = 0;
+    else if (cache->ra_window == 0) cache->ra_window = 2;
+    else cache->ra_window *= 2;
+    if (cache->ra_window > CACHE_READAHEAD_MAX) cache->ra_window = CACHE_READAHEAD_MAX;
+
+    while (n < cache->ra_window){
+        unsigned long long ra_pos = pos + (n + 1) * CACHE_BLKSZ;
+        int idx;
+
+        if (ra_pos + CACHE_BLKSZ > cache->disk->capacity) break;
+        if (cache_lookup(cache, ra_pos) != CACHE_NOSLOT || cache_direct_fenced(cache, ra_pos)) break;
+        idx = cache_claim_slot(cache, 0);
+        if (idx < 0) break;
+
+        //nobody has asked for the block yet, so it starts in probation whatever the ghosts say
+        cache->slots[idx].prefetched = 1;
+        cache_index_insert(cache, idx, ra_pos);
+        cache_set_queue(cache, idx, CACHE_A1IN);
+        batch[++n] = idx;
+    }
+
+    cache->ra_next = pos + (n + 1) * CACHE_BLKSZ;
+    return n;
+}
+
+/**
+ * @brief takes a hold on a pinned slot, shared or exclusive, waiting for holders that are in the
+ * way. the wait drops cache->lock, and the pin is what keeps the slot from changing hands meanwhile.
+ * caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to hold
+ * @param shared nonzero for a shared hold
+ */
+static void cache_slot_lock(struct cache* cache, int idx, int shared){
+    struct cache_slot * slot = &cache->slots[idx];
+    int tid = running_thread();
+
+    if (slot->writer == tid){ //already ours, so this just nests
+        slot->wcnt++;
+        return;
+    }
+    if (slot->writer != CACHE_NOWRITER || (!shared && slot->nreaders > 0)) cache->stats.pin_waits++;
+    while (slot->writer != CACHE_NOWRITER || (!shared && slot->nreaders > 0)){
+        lock_release(&cache->lock);
+        //releasing a lock never switches threads, so the broadcast from cache_slot_unlock can't
+        //slip in between the release and the wait
+        condition_wait(&slot->unlocked);
+        lock_acquire(&cache->lock);
+    }
+    if (shared) slot->nreaders++;
+    else {
+        slot->writer = tid;
+        slot->wcnt = 1;
+    }
+}
+
+/**
+ * @brief lets go of a hold taken with cache_slot_lock(). caller must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param idx slot to let go of
+ */
+static void cache_slot_unlock(struct cache* cache, int idx){
+    struct cache_slot * slot = &cache->slots[idx];
+
+    if (slot->writer == running_thread()){
+        if (--slot->wcnt > 0) return;
+        slot->writer = CACHE_NOWRITER;
+    } else {
+        assert(slot->nreaders > 0);
+        if (--slot->nreaders > 0) return;
+    }
+    condition_broadcast(&slot->unlocked);
+}
+
+/**
+ * @brief sorts a list of slot indexes by the position of the block each slot holds (shell sort,
+ * since the list can be as long as the cache)
+ * @param cache Pointer to the cache.
+ * @param idxs slot indexes to sort in place
+ * @param n number of entries in idxs
+ */
+static void cache_sort_by_pos(struct cache* cache, int* idxs, int n){
+    for (int gap = n / 2; gap > 0; gap /= 2){
+        for (int i = gap; i < n; i++){
+            int idx = idxs[i];
+            int j = i;
+            while (j >= gap && cache->slots[idxs[j - gap]].pos > cache->slots[idx].pos){
+                idxs[j] = idxs[j - gap];
+                j -= gap;
+            }
+            idxs[j] = idx;
+        }
+    }
+}
+
+/**
+ * @brief opens dev/cachestat<n>. any number of readers can have it open
+ * @param ser the statdev of a cache
+ * @return 0
+ */
+static int cache_stat_open(struct serial* ser){
     return 0;
 }
+
+/**
+ * @brief closes dev/cachestat<n>. nothing to undo
+ * @param ser the statdev of a cache
+ */
+static void cache_stat_close(struct serial* ser){
+}
+
+/**
+ * @brief reads a snapshot of the counters of the cache, like cache_get_stats()
+ * @param ser the statdev of a cache
+ * @param buf buffer to read into
+ * @param bufsz buffer size in bytes
+ * @return sizeof(struct cache_stats), or 0 if buf is too small to hold it
+ */
+static int cache_stat_recv(struct serial* ser, void* buf, unsigned int bufsz){
+    struct cache* const cache = (void*)ser - offsetof(struct cache, statdev);
+
+    if (bufsz < sizeof(struct cache_stats)) return 0;
+    cache_get_stats(cache, buf);
+    return sizeof(struct cache_stats);
+}
+
+/**
+ * @brief control operations on dev/cachestat<n>. FCNTL_RESET zeroes the counters
+ * @param ser the statdev of a cache
+ * @param op FCNTL_RESET
+ * @param arg unused
+ * @return 0 on success, -ENOTSUP for any other op
+ */
+static int cache_stat_cntl(struct serial* ser, int op, void* arg){
+    struct cache* const cache = (void*)ser - offsetof(struct cache, statdev);
+
+    if (op != FCNTL_RESET) return -ENOTSUP;
+    cache_reset_stats(cache);
+    return 0;
+}
+
+#if CACHE_RECORD_MAX > 0
+/**
+ * @brief adds a record to the access trace, unless recording is off or the trace is full. caller
+ * must hold cache->lock
+ * @param cache Pointer to the cache.
+ * @param rec block position and CACHE_REC_* bits
+ */
+static void cache_record(struct cache* cache, unsigned long long rec){
+    if (cache->rec_on && cache->rec_len < CACHE_RECORD_MAX) cache->rec[cache->rec_len++] = rec;
+}
+
+/**
+ * @brief opens dev/cachetrace<n> and stops the recording, so what's read back is a fixed trace
+ * @param ser the tracedev of a cache
+ * @return 0, or -ENOTSUP if the cache had no room for a trace
+ */
+static int cache_trace_open(struct serial* ser){
+    struct cache* const cache = (void*)ser - offsetof(struct cache, tracedev);
+
+    if (cache->rec == NULL) return -ENOTSUP;
+    lock_acquire(&cache->lock);
+    cache->rec_on = 0;
+    lock_release(&cache->lock);
+    return 0;
+}
+
+/**
+ * @brief closes dev/cachetrace<n>. recording stays off until FCNTL_RESET
+ * @param ser the tracedev of a cache
+ */
+static void cache_trace_close(struct serial* ser){
+}
+
+/**
+ * @brief reads the next records of the access trace. records read once aren't read again
+ * @param ser the tracedev of a cache
+ * @param buf buffer to read into
+ * @param bufsz buffer size in bytes
+ * @return bytes read, 0 once the whole trace has been read
+ */
+static int cache_trace_recv(struct serial* ser, void* buf, unsigned int bufsz){
+    struct cache* const cache = (void*)ser - offsetof(struct cache, tracedev);
+    int n;
+
+    lock_acquire(&cache->lock);
+    n = MIN(bufsz / sizeof(unsigned long long), cache->rec_len - cache->rec_read);
+    memcpy(buf, &cache->rec[cache->rec_read], n * sizeof(unsigned long long));
+    cache->rec_read += n;
+    lock_release(&cache->lock);
+    return n * sizeof(unsigned long long);
+}
+
+/**
+ * @brief control operations on dev/cachetrace<n>. FCNTL_RESET throws the trace away and starts
+ * recording a new one
+ * @param ser the tracedev of a cache
+ * @param op FCNTL_RESET
+ * @param arg unused
+ * @return 0 on success, -ENOTSUP for any other op
+ */
+static int cache_trace_cntl(struct serial* ser, int op, void* arg){
+    struct cache* const cache = (void*)ser - offsetof(struct cache, tracedev);
+
+    if (op != FCNTL_RESET) return -ENOTSUP;
+    lock_acquire(&cache->lock);
+    cache->rec_len = 0;
+    cache->rec_read = 0;
+    cache->rec_on = 1;
+    lock_release(&cache->lock);
+    return 0;
+}
+#endif
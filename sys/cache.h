@@ -9,10 +9,60 @@
 #define _CACHE_H_
 
 #define CACHE_BLKSZ 512  // size of cache block
-#define CACHE_SIZE 64
+
+// flags for cache_get_block_flags() and cache_get_blocks()
+#define CACHE_SHARED 0x1  // hold the block for reading only, alongside other shared holders
+#define CACHE_META 0x2    // filesystem metadata: keep it resident through long scans of other blocks
+
+// replacement policies, see cache_set_policy()
+#define CACHE_POLICY_2Q 0   // scan resistant, the default
+#define CACHE_POLICY_LRU 1  // plain least recently used, CACHE_META is ignored
+
+// position lookups, see cache_set_lookup()
+#define CACHE_LOOKUP_HASH 0  // the position index, the default
+#define CACHE_LOOKUP_SCAN 1  // a scan of every slot, for benchmarks only
+
+// line sizes for create_cache_mode(). blocks are still handed out CACHE_BLKSZ at a time either way
+#define CACHE_MODE_BLOCK 0  // one CACHE_BLKSZ block per line
+#define CACHE_MODE_PAGE 1   // page sized, page aligned lines of PAGE_SIZE / CACHE_BLKSZ blocks
 
 struct storage;  // external
 struct cache;    // opaque decl.
+
+// every cache registers a serial device named "cachestat" (so the first one is dev/cachestat0). each
+// read gets one struct cache_stats, a fresh snapshot, and FCNTL_RESET zeroes the counters
+
+// with CACHE_RECORD_MAX set, every cache also registers a "cachetrace" device that reads back the
+// gets and releases it has seen, one unsigned long long record each: the block position, with the
+// low bits (free since positions are multiples of CACHE_BLKSZ) saying what happened. opening the
+// device stops the recording, so reading the trace into a file doesn't add to it, and FCNTL_RESET
+// empties it and starts recording again. util/cachesim replays traces on the host
+#define CACHE_REC_RELEASE 0x1    // the block was released, else it was gotten
+#define CACHE_REC_DIRTY 0x2      // released dirty
+#define CACHE_REC_FLAGS_SHIFT 2  // a get's flags (CACHE_SHARED, CACHE_META), shifted up this far
+#define CACHE_REC_POS(rec) ((rec) & ~(unsigned long long)(CACHE_BLKSZ - 1))
+
+/// @brief counters a cache keeps about itself, see cache_get_stats()
+struct cache_stats {
+    unsigned long long hits; // cache_get_block() calls that found the block cached
+    unsigned long long misses; // cache_get_block() calls that had to go to the disk
+    unsigned long long prefetched; // blocks brought in by read-ahead
+    unsigned long long prefetch_hits; // read-ahead blocks that were asked for later
+    unsigned long long prefetch_wasted; // read-ahead blocks evicted without ever being asked for
+    unsigned long long direct; // blocks read past the cache with cache_fetch_direct()
+    unsigned long long direct_stores; // blocks written past the cache with cache_store_direct()
+    unsigned long long evictions; // lines dropped to make room for others
+    unsigned long long writebacks; // dirty lines written back to the disk
+    unsigned long long sync_stores; // write-backs some caller waited for, rather than the flusher thread
+    unsigned long long pin_waits; // times a thread had to wait for another one to let go of a line
+    unsigned long long fetch_ticks; // time spent in storage_fetch(), in rdtime() ticks (TIMER_FREQ a second)
+};
+
+/// @brief settings of the background flusher of a cache, see cache_set_flush_params()
+struct cache_flush_params {
+    unsigned long interval_ms; // time between background flushes, 0 to only flush when kicked
+    unsigned int dirty_bg_pct; // percent of the cache dirty that starts a flush before the interval is up
+};
 // struct cache {
 //     struct cache_block * blocks[CACHE_SIZE];
 //     struct lock cache_locks[CACHE_SIZE];// indexes for cache_blocks correspond to indexes for cache_locks
@@ -33,9 +83,23 @@ struct cache;    // opaque decl.
 // }; //__attribute__((packed));
 
 
-extern int create_cache(struct storage* sto, struct cache** cptr);
+extern int create_cache(struct storage* sto, unsigned int capacity, struct cache** cptr);
+extern int create_cache_mode(struct storage* sto, unsigned int capacity, int mode, struct cache** cptr);
+extern int destroy_cache(struct cache* cache);
 extern int cache_get_block(struct cache* cache, unsigned long long pos, void** pptr);
+extern int cache_get_block_flags(struct cache* cache, unsigned long long pos, int flags, void** pptr);
 extern void cache_release_block(struct cache* cache, void* pblk, int dirty);
+extern int cache_get_blocks(struct cache* cache, unsigned long long pos, int n, int flags, void** ptrs);
+extern void cache_release_blocks(struct cache* cache, void** ptrs, int n, int dirty);
 extern int cache_flush(struct cache* cache);
+extern long cache_prefetch(struct cache* cache, unsigned long long pos, unsigned long n, int flags);
+extern long cache_fetch_direct(struct cache* cache, unsigned long long pos, void* buf, unsigned long len);
+extern long cache_store_direct(struct cache* cache, unsigned long long pos, const void* buf, unsigned long len);
+extern void cache_get_stats(struct cache* cache, struct cache_stats* stats);
+extern void cache_reset_stats(struct cache* cache);
+extern int cache_set_policy(struct cache* cache, int policy);
+extern int cache_set_lookup(struct cache* cache, int lookup);
+extern int cache_set_flush_params(struct cache* cache, const struct cache_flush_params* params);
+extern void cache_get_flush_params(struct cache* cache, struct cache_flush_params* params);
 
 #endif  // _CACHE_H_
@@ -98,6 +98,77 @@
 
 #define PROCESS_UIOMAX 16
 
-// Capacity of block cache
+// Default capacity of a block cache (in blocks), used when create_cache() is
+// passed a capacity of 0
 
-#define CACHE_CAPACITY 64  // must be power of two
\ No newline at end of file
+#ifndef CACHE_CAPACITY
+#define CACHE_CAPACITY 64
+#endif
+
+// Most blocks a cache puts in one device request (a read with its read-ahead,
+// or a run of adjacent dirty blocks). Such runs are staged in a per-cache
+// buffer of this many blocks; 8 makes it one page.
+
+#ifndef CACHE_IO_MAX
+#define CACHE_IO_MAX 8
+#endif
+
+// Most blocks a cache reads ahead of a sequential miss. At most
+// CACHE_IO_MAX - 1. 0 turns read-ahead off.
+
+#ifndef CACHE_READAHEAD_MAX
+#define CACHE_READAHEAD_MAX (CACHE_IO_MAX - 1)
+#endif
+
+// Defaults for the background flusher of a cache, see cache_set_flush_params().
+// The flusher writes every dirty block back each interval, and early when the
+// dirty share of the cache reaches the threshold.
+
+#ifndef CACHE_FLUSH_INTERVAL_MS
+#define CACHE_FLUSH_INTERVAL_MS 500
+#endif
+
+#ifndef CACHE_DIRTY_BG_PCT
+#define CACHE_DIRTY_BG_PCT 25
+#endif
+
+// Entries of the access trace each cache records from its creation on (8 bytes
+// each), read back through dev/cachetrace<n> and replayed on the host with
+// util/cachesim. 0 leaves recording out of the kernel.
+
+#ifndef CACHE_RECORD_MAX
+#define CACHE_RECORD_MAX 0
+#endif
+
+// KTFS reads and writes of at least this many bytes move their whole blocks
+// between the device and the caller's buffer instead of through the cache, one
+// request per run of adjacent blocks (see cache_fetch_direct() and
+// cache_store_direct()). Only a partial block at either end goes through the
+// cache. A file can also be switched to that for all I/O with FCNTL_DIRECT.
+
+#ifndef KTFS_DIRECT_MIN
+#define KTFS_DIRECT_MIN (16 * 1024)
+#endif
+
+// Whether mount_ktfs() reads the inode bitmap, block bitmap and inode table into
+// the cache up front (up to half the cache), in large requests and as
+// CACHE_META, instead of one miss at a time as files are opened and allocated.
+
+#ifndef KTFS_MOUNT_WARMUP
+#define KTFS_MOUNT_WARMUP 1
+#endif
+
+// Whether main.c prints how long mounting the C drive and the first open of
+// the init program took. Off by default, so a normal boot stays quiet.
+
+#ifndef BOOT_TIMING
+#define BOOT_TIMING 0
+#endif
+
+// When a KTFS file can't grow in place (the block after its end is taken), its
+// new blocks go at the start of a free run at least this many blocks long, so
+// files appended to in turn each get room to keep growing in one piece.
+
+#ifndef KTFS_ALLOC_WINDOW
+#define KTFS_ALLOC_WINDOW 64
+#endif
\ No newline at end of file
@@ -225,9 +225,9 @@ static long vioblk_storage_fetch(struct storage* sto, unsigned long long pos, vo
     // [10/21 07:04] For vioblk_storage_store and vioblk_storage_fetch, writes & reads that exceed the end of the block device should be truncated. Do not return a negative error code in these scenarios.
     if (pos + bytecnt > sto->capacity) bytecnt = sto->capacity - pos;
     
-    void *virtio_buf = kmalloc(bytecnt);
-    // fill descriptor table
-    fill_descriptor_table(blk->desc, &blk->header, virtio_buf, bytecnt, &blk->status, 1);
+    // fill descriptor table. the device writes straight into buf, like store reads straight from it,
+    // so a request isn't limited to what kmalloc can hand out
+    fill_descriptor_table(blk->desc, &blk->header, buf, bytecnt, &blk->status, 1);
     // Add message to avail ring
     blk->avail->ring[blk->avail->idx % blk->virtqueue_size] = 0;
     __sync_synchronize(); // 2.7.13
@@ -249,8 +249,6 @@ static long vioblk_storage_fetch(struct storage* sto, unsigned long long pos, vo
 
     if (blk->status == VIRTIO_BLK_S_IOERR) bytecnt = -EIO; // 5.2.6
     if (blk->status == VIRTIO_BLK_S_UNSUPP) bytecnt = -ENOTSUP; // 5.2.6
-    memcpy(buf, virtio_buf, bytecnt);
-    kfree(virtio_buf);
 
     lock_release(&blk->lock);
     return bytecnt;
@@ -174,15 +174,25 @@ int register_device(const char *name, enum device_type type, void *device_struct
             return -EINVAL;
     }
 
-    // Walk through device list to determine the instance number for the device.
-    // When we finish, /dptr/ points to the /next/ member of the last device in
-    // the list (if not list is not empty) or to /devlist/ if the list is empty
-    // (devlist == NULL).
+    // Walk through device list to find its end. When we finish, /dptr/ points to
+    // the /next/ member of the last device in the list (if not list is not empty)
+    // or to /devlist/ if the list is empty (devlist == NULL).
 
     dptr = &devlist;
-    while ((dev = *dptr) != NULL) {
-        instno += (strcmp(name, dev->name) == 0);
+    while ((dev = *dptr) != NULL)
         dptr = &dev->next;
+
+    // The instance number is the lowest one no device of this name has. Devices
+    // can be unregistered, so it isn't always the number of them.
+
+    for (;;) {
+        for (dev = devlist; dev != NULL; dev = dev->next) {
+            if (strcmp(name, dev->name) == 0 && dev->instno == instno)
+                break;
+        }
+        if (dev == NULL)
+            break;
+        instno++;
     }
 
     // Allocate device_record struct and fill it in.
@@ -202,6 +212,27 @@ int register_device(const char *name, enum device_type type, void *device_struct
     return instno;
 }
 
+/**
+ * @brief Function to take a device out of the device list, once whatever registered it is done
+ * with it. Nothing may have it open. Its instance number is free for the next device registered
+ * under the same name
+ * @param device_struct device struct that was passed to register_device()
+ * @return 0 on success, -ENOENT if the device isn't in the list
+ */
+int unregister_device(void *device_struct) {
+    struct device_record **dptr = &devlist;
+    struct device_record *dev;
+
+    while ((dev = *dptr) != NULL && dev->device_struct != device_struct)
+        dptr = &dev->next;
+    if (dev == NULL)
+        return -ENOENT;
+
+    *dptr = dev->next;
+    kfree(dev);
+    return 0;
+}
+
 /**
  * @brief Function to find a device in the device list
  * @param name name of the device to be found
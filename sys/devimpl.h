@@ -10,6 +10,7 @@
 #include "device.h"
 
 extern int register_device(const char* name, enum device_type type, void* device_struct);
+extern int unregister_device(void* device_struct);
 
 // SERIAL DEVICES
 //
@@ -37,6 +37,7 @@
 #include "ktfs.h"
 
 #include "cache.h"
+#include "conf.h"
 #include "console.h"
 #include "device.h"
 #include "devimpl.h"
@@ -44,6 +45,7 @@
 #include "filesys.h"
 #include "fsimpl.h"
 #include "heap.h"
+#include "memory.h"
 #include "misc.h"
 #include "string.h"
 #include "thread.h"
@@ -52,14 +54,27 @@
 
 //notably, store is the most normal case. 
 //create operates on the root directory inode, which needs to be fetched from the backing device, (pass NULL for inode)
-//and setend the operation into a noop/memset0 (haven't decided which one yet) on the file of choice (pass NULL for buf and bytecnt)
 #define F_APPEND_STORE 0
 #define F_APPEND_CREATE 1
-#define F_APPEND_SETEND 2
+
+#define KTFS_NOFILE -1 // end of a name hash chain
+#define KTFS_NAME_MIN_SLOTS 128 // smallest name index, one page
+#define KTFS_FILE_BUCKETS 64 // chains in the table of file records
+#define KTFS_BITS_PER_BLK (KTFS_BLKSZ*8) // blocks (or inodes) one bitmap block covers
+#define KTFS_NOGOAL UINT32_MAX // no preferred place for an allocation, use the next-fit cursor
 
 // INTERNAL TYPE DEFINITIONS
 //
 
+/// @brief allocator state for one of the two bitmaps (data blocks or inodes). free is counted from the bitmap at
+/// mount and kept up to date by claim and release
+struct ktfs_bitmap_state {
+    uint32_t start; // absolute block index of the first bitmap block
+    uint32_t nbits; // data blocks (or inodes) the image actually has. bits past this are never handed out
+    uint32_t hint; // next-fit cursor: searches without a goal start here
+    uint16_t * free; // free bits in each bitmap block (at most KTFS_BITS_PER_BLK)
+};
+
 struct ktfs {
     struct filesystem fs;
     //superblock data. provided in the makefile from the beginning
@@ -81,35 +96,75 @@ struct ktfs {
     //int num_files; post cp1 change: this is a redundancy
 
     struct ktfs_inode root_directory_inode_data; //we always update this when we change the root directory inode
+
+    //a hashed root directory (KTFS_FEATURE_HASHDIR, see ktfs.h) is looked up on disk and needs nothing in memory
+    int hashdir;
+    uint32_t dir_nbuckets; // blocks in it
+
+    //name index over the dentry slots of a flat root directory, and all mount keeps per file. chains of dentry slots
+    //hashed by name, kept up to date by create and delete. a slot whose hash matches still has its name checked,
+    //against the file's record if it has one and the dentry otherwise
+    uint32_t * slot_hash; // name_nslots entries, name hash of the file in each dentry slot
+    int * slot_next; // name_nslots entries, next dentry slot in the same bucket
+    int * name_heads; // name_nslots entries (a bucket per slot), first dentry slot in each bucket
+    int name_nslots; // a power of two. create doubles it when the directory outgrows it
+    int name_npages; // pages the three arrays take. they're one allocation, from the page allocator
+
+    //a file record (struct ktfs_file) is only made when the file is opened. the records there are, chained by dentry slot
+    struct ktfs_file * file_heads[KTFS_FILE_BUCKETS];
+
+    //kfree doesn't give memory back, so the records of closed files and the uios of closed opens are kept for reuse
+    struct ktfs_file * free_files;
+    struct ktfs_file_uio * free_uios;
+
+    struct ktfs_bitmap_state db_map; // data block allocator
+    struct ktfs_bitmap_state ino_map; // inode allocator
 };
 
 
-/// @brief File struct for a file in the Keegan Teal Filesystem
+/// @brief File struct for a file in the Keegan Teal Filesystem. made by the first open of the file (see ktfs_file_get)
+/// and given up by the last close
 struct ktfs_file {
-    struct uio base;
-
-    struct ktfs_dir_entry dentry; //scanned dentry data of the file (in mount). note that if the file is deleted, the whole struct gets freed anyway
+    struct ktfs_dir_entry dentry; //dentry data of the file, copied in when the record is made
     
-    int opened; 
-    uint32_t pos; // Position in the current opened file
+    int nopen; // opens of the file (struct ktfs_file_uio) that haven't been closed. they all share inode_data
 	uint32_t dentry_slot;
-    struct ktfs_inode inode_data; // we fill out the inode data when we open the file. when we close the file, free it and set the pointer to null. 
+
+    //inode cache: the record holds the file's inode from the first open, which reads it in, to the last close. writes
+    //only change this copy and set inode_dirty; ktfs_inode_writeback puts it back in the inode table on close and on
+    //flush. a record whose inode couldn't be written back is kept, dirty, until a flush manages it
+    struct ktfs_inode inode_data;
+    int inode_loaded; // 1 once inode_data has been read in
+    int inode_dirty; // 1 if inode_data has changes the inode table doesn't have yet
+
+    //opens share inode_data and the file's blocks, so the changes to them go one at a time: stores (which fill holes
+    //and append), SETEND and writeback each hold this for the whole change. fetches don't take it
+    struct lock lock;
+    struct ktfs_file * next; // next record in the same ktfs->file_heads chain, or in ktfs->free_files
 };
 
-struct ktfs_file_records{
-    uint64_t reserved;
-    struct ktfs_file * filetab[];
+/// @brief one open of a file. every ktfs_open makes a new one, so any number of threads can have the same file open,
+/// each with its own position, over the one in-memory inode in the file's ktfs_file
+struct ktfs_file_uio {
+    struct uio base;
+    struct ktfs_file * file;
+    uint32_t pos; // Position in the current opened file
+    int direct; // 1 if whole blocks are read and written past the cache whatever the length (FCNTL_DIRECT)
+
+    //block map cache: a copy of the last indirect (or second level doubly-indirect) block a lookup went through, so a
+    //sequential pass reads one index block per 128 data blocks instead of one or two per data block. see ktfs_file_block_idx
+    uint32_t * blkmap; // KTFS_BLKSZ bytes, allocated on first use and kept with the uio when it's reused
+    uint32_t blkmap_first; // file block the copy's first entry maps
+    uint32_t blkmap_valid; // entries in the copy that were in use when it was made (the rest may get written later)
+    struct ktfs_file_uio * next_free; // next uio in ktfs->free_uios
 };
 
 
 struct ktfs_listing_uio {
     struct uio base;
-    int read_idx;
-    const struct ktfs_file_records * records;
+    int read_idx; // dentry slot of the next name
 };
 
-struct ktfs_file_records * records; //our singular book-keeping system for files
-
 struct ktfs * ktfs; // Changed to a global, bc we only have one ktfs
 
 
@@ -130,12 +185,40 @@ void ktfs_listing_close(struct uio* uio);
 long ktfs_listing_read(struct uio* uio, void* buf, unsigned long bufsz);
 
 int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, uint32_t contiguous_db_index);
-int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, void * buf, int bytecnt, int op);
-int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_t contigous_db_idx_to_add);
-int ktfs_find_and_use_free_db_slot(struct cache* cache);
+static int ktfs_file_block_idx(struct ktfs_file_uio* fu, uint32_t contiguous_db_index);
+static int ktfs_inode_writeback(struct ktfs_file* file);
+static int ktfs_file_fill_hole(struct ktfs_file_uio* fu, uint32_t contiguous_db_index, uint32_t goal);
+static int ktfs_file_setend(struct ktfs_file_uio* fu, uint32_t end);
+static long ktfs_file_store(struct ktfs_file_uio* fu, const void* buf, unsigned long len);
+static int ktfs_index_punch(struct cache* cache, uint32_t index_db, uint32_t from, uint32_t to);
+int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, struct ktfs_file_uio* fu, void * buf, int bytecnt, int op);
+int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_t contigous_db_idx_to_add, uint32_t goal);
+int ktfs_find_and_use_free_db_slot(struct cache* cache, uint32_t goal);
+static int ktfs_alloc_index_block(struct cache* cache, uint32_t goal);
 int ktfs_find_and_use_free_inode_slot(struct cache* cache);
 int ktfs_free_db_slot(struct cache* cache, uint32_t db_blk_num);//
 int ktfs_free_inode_slot(struct cache* cache, uint32_t inode_slot_num); //
+int ktfs_free_file_blocks(struct cache* cache, const struct ktfs_inode* inode);
+static int ktfs_name_lookup(const char* name, struct ktfs_dir_entry* dentry);
+static void ktfs_name_insert(int slot, unsigned int hash);
+static void ktfs_name_remove(int slot);
+static int ktfs_name_index_resize(int nslots, int nfiles);
+static int ktfs_dentry_read(int slot, struct ktfs_dir_entry* dentry);
+static struct ktfs_file * ktfs_file_find(int slot);
+static struct ktfs_file * ktfs_file_get(int slot, const struct ktfs_dir_entry* dentry);
+static void ktfs_file_put(struct ktfs_file* file);
+static void ktfs_file_unlink(struct ktfs_file* file);
+static void ktfs_file_move(struct ktfs_file* file, int slot);
+static int ktfs_hashdir_lookup(const char* name, struct ktfs_dir_entry* dentry);
+static int ktfs_hashdir_create(const char* name);
+static int ktfs_hashdir_delete(const char* name);
+static int ktfs_ctz64(uint64_t x);
+static int ktfs_bitmap_init(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t start, uint32_t nbits);
+static int ktfs_bitmap_claim(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t goal);
+static uint32_t ktfs_bitmap_find_run(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t from, uint32_t want);
+static int ktfs_bitmap_run_is_free(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t start, uint32_t n);
+static int ktfs_bitmap_release(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t idx);
+static int ktfs_popcount64(uint64_t x);
 
 
 static const struct uio_intf initial_file_uio_intf = {
@@ -153,50 +236,89 @@ static const struct uio_intf ktfs_listing_uio_intf  = {
 //the next two are exactly what it sounds like
 //NOTE: db_blk_num/inoed_slot_num is the DATA_BLOCK_INDEX/INODE_SLOT_INDEX of the block we're trying to free, not the absolute index like we've so often used for other function
 int ktfs_free_db_slot(struct cache* cache, uint32_t db_blk_num){
-    void * blkptr;
-	int abs_blk_of_bitmap = db_blk_num/(KTFS_BLKSZ*8)+ktfs->bitmap_block_start;
-    cache_get_block(cache, abs_blk_of_bitmap*KTFS_BLKSZ, &blkptr);
-	int index = (db_blk_num%(KTFS_BLKSZ*8))/8;
-	int offset = (db_blk_num%(KTFS_BLKSZ*8))%8;
-	if ((((char *)blkptr)[index] & (0x01<<offset)) == 0) trace("warning: decided to free a datablock that has already been freed");//comment out this line when its time to submit
-	((char *)blkptr)[index] &= ~(0x01<<offset);
-    cache_release_block(cache, blkptr, 1);
-    return 0;
+    int retval = ktfs_bitmap_release(cache, &ktfs->db_map, db_blk_num);
+	if (retval > 0) trace("warning: decided to free a datablock that has already been freed");//comment out this line when its time to submit
+    return (retval < 0) ? retval : 0;
 }
 int ktfs_free_inode_slot(struct cache* cache, uint32_t inode_slot_num){
+    int retval = ktfs_bitmap_release(cache, &ktfs->ino_map, inode_slot_num);
+	if (retval > 0) trace("warning: decided to free an inode that has already been freed");//comment out this line when its time to submit
+    return (retval < 0) ? retval : 0;
+}
+
+/*
+* @ brief: gives back every block a file holds: its data blocks, the indirect block and the doubly-indirect tree. holes
+*          (see KTFS_HOLE) hold nothing, at any level. a data block that's a hole is past the end of the bitmap, so
+*          ktfs_free_db_slot turns it down. no index block is held while the bitmap is updated: with page lines both
+*          could be in one line, and a shared hold there would keep the bitmap's exclusive get waiting forever
+* @ parameters: backing cache pointer, a copy of the file's inode (left as is)
+* @ return: 0, or a negative error code if an index block couldn't be read (whatever was freed before that stays freed)
+*/
+int ktfs_free_file_blocks(struct cache* cache, const struct ktfs_inode* inode){
+    uint32_t nblks = (inode->size + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+    uint32_t entries[KTFS_BLKSZ / sizeof(uint32_t)]; //an index block's entries, copied out so it isn't held while the bitmap is
     void * blkptr;
-	int abs_blk_of_bitmap = inode_slot_num/(KTFS_BLKSZ*8)+ktfs->inode_bitmap_block_start;
-    cache_get_block(cache, abs_blk_of_bitmap*KTFS_BLKSZ, &blkptr);	
-	int index = (inode_slot_num%(KTFS_BLKSZ*8))/8;
-	int offset = (inode_slot_num%(KTFS_BLKSZ*8))%8;
-	if ((((char *)blkptr)[index] & (0x01<<offset)) == 0) trace("warning: decided to free an inode that has already been freed");//comment out this line when its time to submit
-	((char *)blkptr)[index] &= ~(0x01<<offset);
-    cache_release_block(cache, blkptr, 1);
+
+    for (uint32_t i = 0; i < MIN(nblks, KTFS_NUM_DIRECT_DATA_BLOCKS); i++) ktfs_free_db_slot(cache, inode->block[i]);
+    if (nblks <= KTFS_NUM_DIRECT_DATA_BLOCKS) return 0;
+    nblks -= KTFS_NUM_DIRECT_DATA_BLOCKS;
+
+    if (inode->indirect != KTFS_HOLE){
+        if (cache_get_block_flags(cache, (inode->indirect + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+        memcpy(entries, blkptr, KTFS_BLKSZ);
+        cache_release_block(cache, blkptr, 0);
+        for (uint32_t i = 0; i < MIN(nblks, 128); i++) ktfs_free_db_slot(cache, entries[i]);
+        ktfs_free_db_slot(cache, inode->indirect);
+    }
+    if (nblks <= 128) return 0;
+    nblks -= 128;
+
+    for (int d = 0; d < KTFS_NUM_DINDIRECT_BLOCKS && d*128*128 < nblks; d++){
+        uint32_t nleaves = MIN(nblks - d*128*128, 128*128);
+
+        if (inode->dindirect[d] == KTFS_HOLE) continue;
+        for (uint32_t j = 0; j < (nleaves + 127)/128; j++){
+            uint32_t lvl_two_db;
+
+            //one entry at a time, so the top block is let go before the bitmap is taken too
+            if (cache_get_block_flags(cache, (inode->dindirect[d] + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+            lvl_two_db = ((uint32_t *)blkptr)[j];
+            cache_release_block(cache, blkptr, 0);
+            if (lvl_two_db == KTFS_HOLE) continue;
+
+            if (cache_get_block_flags(cache, (lvl_two_db + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+            memcpy(entries, blkptr, KTFS_BLKSZ);
+            cache_release_block(cache, blkptr, 0);
+            for (uint32_t i = 0; i < MIN(nleaves - j*128, 128); i++) ktfs_free_db_slot(cache, entries[i]);
+            ktfs_free_db_slot(cache, lvl_two_db);
+        }
+        ktfs_free_db_slot(cache, inode->dindirect[d]);
+    }
     return 0;
 }
 
 /*
 * @ brief: starting from the end of an inodes data (SPECIFICALLY does not deal with data before the end of the file), WRITES more data to the inode while also allocating more dentry blocks where needed
-* @ parameters: backing cache pointer, inode to extend, and number of bytes to extend. if we wish to operate on the root directory inode, pass NULL as the inode and 
+* @ parameters: backing cache pointer, inode to extend, the open file the write goes through (NULL for the root directory), and number of bytes to extend. if we wish to operate on the root directory inode, pass NULL as the inode and 
 * @ returns: returns the number of bytes that were written, or a negative number if an error occurred
 *
-* @ NOTE TO CALLER: DO NOOOOOT TRY TO USE THIS FUNCTION FOR AN INODE THAT ISN'T EITHER INSIDE OF A KTFS_FILE STRUCT OR
-*                   A ROOT DIRECTORY INODE. PART OF THIS FUNCTION UTILIZES OFFSET_OF TO GET ACCESS TO THE WRAPPING KTFS_FILE STRUCT
+* @ NOTE TO CALLER: FOR F_APPEND_STORE THE INODE MUST BE fu->file->inode_data, THE ONE EVERY OPEN OF THE FILE SHARES, AND YOU MUST HOLD fu->file->lock
 * @ ANOTHER NOTE TO CALLER: MAKE SURE THE ROOT DIRECTORY INODE IS DYNAMICALLY ALLOCATED ATLEAST FOR THE DURATION OF THIS FUNCTION! I DO NOT WANT THAT SHIT ON THE STACK
 */
-int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, void * buf, int bytecnt, int op){ 
-    trace("%s(cache=%p, inode=%p, bytecnt=%u)\n", __func__, cache, inode, bytecnt);
+int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, struct ktfs_file_uio* fu, void * buf, int bytecnt, int op){ 
+    trace("%s(cache=%p, inode=%p, fu=%p, bytecnt=%u)\n", __func__, cache, inode, fu, bytecnt);
     struct ktfs_file * file_wrapper;
     uint16_t inode_num; //specifically the number of the inode (we already have the root directory inode number as well)
 
     //guard cases
     if (bytecnt ==0) return 0;
-    if (op != F_APPEND_SETEND && op != F_APPEND_STORE && op != F_APPEND_CREATE) return -ENOTSUP;
+    if (op != F_APPEND_STORE && op != F_APPEND_CREATE) return -ENOTSUP;
 
 
-    if (op == F_APPEND_SETEND || op == F_APPEND_STORE){
-        file_wrapper = (void *)inode - offsetof(struct ktfs_file, inode_data);
-        if (file_wrapper->pos != inode->size) return -ENOTSUP; //Dawg I just told you, this function can only be called if we're at the end of the file
+    if (op == F_APPEND_STORE){
+        file_wrapper = fu->file;
+        assert(inode == &file_wrapper->inode_data);
+        if (fu->pos != inode->size) return -ENOTSUP; //Dawg I just told you, this function can only be called if we're at the end of the file
         inode_num = file_wrapper->dentry.inode;
     }
     else if (op==F_APPEND_CREATE){
@@ -215,56 +337,140 @@ int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, void * buf, int
 
     int nstored = 0;
     void * blkptr;
+    void * run_blks[CACHE_IO_MAX];
+    int leftover_index = -1; //a block allocated at the end of the last pass that wasn't next to the rest of its run
+    int hole_head = 0; //bytes at the start of the first block of this pass that were a hole, and have to be zeroed
+    int direct = (op == F_APPEND_STORE) && (fu->direct || bytecnt >= KTFS_DIRECT_MIN); //see ktfs_store
+
+    //a file's inode goes back to the inode table on close or flush (see ktfs_inode_writeback). set up front, since a
+    //pass that fails partway may already have grown it
+    if (op != F_APPEND_CREATE) file_wrapper->inode_dirty = 1;
+
+    //where the new blocks should go: right after the file's last block if there's room there for all of them (index
+    //blocks included, they go inline), otherwise the first free run of KTFS_ALLOC_WINDOW (or as many as we need, if
+    //that's more). each allocation after the first aims for the block after the one before it, so a store lays the
+    //file out in one piece when it can, and the rest of the window is there for the next append. a file that ends in
+    //a hole has no last block to go after
+    uint32_t goal = KTFS_NOGOAL;
+    uint32_t new_blks = (inode->size + bytecnt + KTFS_BLKSZ - 1)/KTFS_BLKSZ - (inode->size + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+    if (new_blks > 0){
+        uint32_t need = new_blks + new_blks/128 + 1;
+        if (inode->size > 0){
+            int last_blk = (op == F_APPEND_CREATE) ? ktfs_get_block_absolute_idx(cache, inode, (inode->size - 1)/KTFS_BLKSZ)
+                : ktfs_file_block_idx(fu, (inode->size - 1)/KTFS_BLKSZ);
+            if (last_blk > 0) goal = last_blk - ktfs->data_block_start + 1;
+        }
+        if (goal == KTFS_NOGOAL || !ktfs_bitmap_run_is_free(cache, &ktfs->db_map, goal, need)){
+            goal = ktfs_bitmap_find_run(cache, &ktfs->db_map, goal, MAX(need, KTFS_ALLOC_WINDOW));
+            //the next file that has to find itself a spot starts looking past this window
+            if (goal != KTFS_NOGOAL) ktfs->db_map.hint = goal + MAX(need, KTFS_ALLOC_WINDOW);
+        }
+    }
+
     while (nstored < bytecnt){
         int allocated_index;
-        if (inode->size % KTFS_BLKSZ == 0) {
+        int first_blk = inode->size/KTFS_BLKSZ;
+        int nblks = MIN((inode->size%KTFS_BLKSZ + bytecnt - nstored + KTFS_BLKSZ - 1)/KTFS_BLKSZ, CACHE_IO_MAX);
+        int whole = direct && inode->size%KTFS_BLKSZ == 0 && bytecnt - nstored >= KTFS_BLKSZ;
+        int nrun;
+
+        //a direct store writes each run of whole blocks from buf with one device request, so its runs aren't
+        //capped by how many blocks the cache can pin at once. a partial block at either end goes through the cache
+        if (whole) nblks = (bytecnt - nstored)/KTFS_BLKSZ;
+        else if (direct) nblks = 1;
+
+        if (leftover_index >= 0) {
+            allocated_index = leftover_index;
+            leftover_index = -1;
+        }
+        else if (inode->size % KTFS_BLKSZ == 0) {
             trace("allocated the datablock: %d\n", inode->size/KTFS_BLKSZ);
-            allocated_index = ktfs_alloc_datablock(cache, inode, inode->size/KTFS_BLKSZ); //in ANY case where pos is exactly a multiple of blksz, that means we're at the beginning of a new block
+            allocated_index = ktfs_alloc_datablock(cache, inode, inode->size/KTFS_BLKSZ, goal); //in ANY case where pos is exactly a multiple of blksz, that means we're at the beginning of a new block
             if (allocated_index <0){
                 trace("alloc_datablock returned a negative value: %s\n", error_name(allocated_index));
                 return allocated_index;
             }//should always allocate in this case
+            goal = allocated_index - ktfs->data_block_start + 1;
 			//trace("allocated_index: %d\n", allocated_index);
         }
-        else allocated_index = ktfs_get_block_absolute_idx(cache, inode, inode->size/KTFS_BLKSZ); 
+        else if (op == F_APPEND_CREATE) allocated_index = ktfs_get_block_absolute_idx(cache, inode, inode->size/KTFS_BLKSZ); 
+        else {
+            //the file's last block is partly filled, unless it's a hole (see ktfs_file_setend)
+            allocated_index = ktfs_file_block_idx(fu, inode->size/KTFS_BLKSZ);
+            if (allocated_index == 0){
+                allocated_index = ktfs_file_fill_hole(fu, inode->size/KTFS_BLKSZ, goal);
+                hole_head = inode->size%KTFS_BLKSZ;
+            }
+            if (allocated_index < 0) return allocated_index;
+            goal = allocated_index - ktfs->data_block_start + 1;
+        }
 
-        int n_per_cycle = MIN(KTFS_BLKSZ - inode->size%KTFS_BLKSZ, bytecnt - nstored);
-        //actual store part
-        if (cache_get_block(cache, allocated_index*KTFS_BLKSZ, &blkptr)<0){// (can make this a noop for setend and operations on the root directory inode, although that's a pretty trivial optimization)
-            trace("cache_get_block returned a negative value\n");
+        //allocate the rest of the blocks this pass fills up front, so the ones that land next to each other on disk
+        //can be pinned (and read) together. an allocation error ends the run here and comes back on the next pass
+        for (nrun = 1; nrun < nblks; nrun++){
+            int next_index = ktfs_alloc_datablock(cache, inode, first_blk + nrun, goal);
+            if (next_index < 0) break;
+            goal = next_index - ktfs->data_block_start + 1;
+            if (next_index != allocated_index + nrun){
+                leftover_index = next_index;
+                break;
+            }
+        }
+
+        if (whole){
+            long ndirect = cache_store_direct(cache, (unsigned long long)allocated_index*KTFS_BLKSZ, (char *)buf+nstored, (unsigned long)nrun*KTFS_BLKSZ);
+            if (ndirect < 0) return ndirect;
+            if (ndirect < (long)nrun*KTFS_BLKSZ) return -EIO;
+            nstored += ndirect;
+            inode->size += ndirect;
+            continue;
+        }
+
+        //actual store part (a create appends a dentry to the root directory, which is metadata)
+        if (cache_get_blocks(cache, (unsigned long long)allocated_index*KTFS_BLKSZ, nrun, (op == F_APPEND_CREATE) ? CACHE_META : 0, run_blks)<0){
+            trace("cache_get_blocks returned a negative value\n");
             return -EINVAL;
         }
 
-        if (op == F_APPEND_SETEND) memset(blkptr+inode->size%KTFS_BLKSZ, 0, n_per_cycle);
-        else memcpy(blkptr+inode->size%KTFS_BLKSZ, buf+nstored, n_per_cycle);
+        if (hole_head > 0) memset(run_blks[0], 0, hole_head);
+        hole_head = 0;
 
-        cache_release_block(cache, blkptr, 1); //we wrote to a block so its dirty
-        
-        //increment values
-        nstored += n_per_cycle;
-        //*pos += n_per_cycle;//do this at the end
-		inode->size +=n_per_cycle;
-        //if (op != F_APPEND_CREATE) inode->size += n_per_cycle; //because for "create" there is no filewrapper, and the pos itsself points to size
+        for (int i = 0; i < nrun; i++){
+            int n_per_cycle = MIN(KTFS_BLKSZ - inode->size%KTFS_BLKSZ, bytecnt - nstored);
+            blkptr = run_blks[i];
 
+            memcpy(blkptr+inode->size%KTFS_BLKSZ, buf+nstored, n_per_cycle);
+
+            //increment values
+            nstored += n_per_cycle;
+            //*pos += n_per_cycle;//do this at the end
+            inode->size +=n_per_cycle;
+            //if (op != F_APPEND_CREATE) inode->size += n_per_cycle; //because for "create" there is no filewrapper, and the pos itsself points to size
+        }
+
+        cache_release_blocks(cache, run_blks, nrun, 1); //we wrote to the blocks so they're dirty
+    }
+	if (op != F_APPEND_CREATE){
+        fu->pos = inode->size;
+        trace("nstored: %d\n", nstored);
+        return nstored;
     }
-	if (op != F_APPEND_CREATE) file_wrapper->pos = inode->size;
 
     //cache_get_block(ktfs_inst->cache_ptr, (ktfs_inst->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK), &blkptr);
     //struct ktfs_inode* rdr = (struct ktfs_inode*)blkptr + (ktfs->root_directory_inode%KTFS_NUM_INODES_IN_BLOCK);
     //lmao I was so sleep deprived that I forgot that I accounted for this, and then designed around this not happening
     //
     //in this current impementation, we perform a DEEP COPY so that the file metadata persists in the filesystem
-    //we do this at the end because doing in every loop would be abysmal TODO: maybe it is required in every loop though
+    //we do this at the end because doing in every loop would be abysmal. only the root directory gets here: create and
+    //delete edit its inode in the table directly as well, so it's written through rather than cached
     trace("inode_num: %d\n", inode_num);
 
-    if (cache_get_block(cache, ((inode_num/KTFS_NUM_INODES_IN_BLOCK)+ktfs->inode_block_start)*KTFS_BLKSZ, &blkptr)< 0){
+    if (cache_get_block_flags(cache, ((inode_num/KTFS_NUM_INODES_IN_BLOCK)+ktfs->inode_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr)< 0){
         trace("cache_get_block returned a negative value\n");
         return -EINVAL;
     }
 
-	kprintf("size before memcpy: %d\n",((struct ktfs_inode *)blkptr)[inode_num].size);
     memcpy((char *)blkptr +(inode_num%KTFS_NUM_INODES_IN_BLOCK)*KTFS_INOSZ, inode, KTFS_INOSZ);//memcpy the inode back into the inode blocks at the correct position (given by inode_num% KTFS_NUM_INODES_IN_BLOCK
-	kprintf("size after memcpy: %d\n",((struct ktfs_inode *)blkptr)[inode_num].size);
     cache_release_block(cache, blkptr, 1);
 	
     trace("nstored: %d\n", nstored);
@@ -273,18 +479,24 @@ int ktfs_appender(struct cache* cache, struct ktfs_inode* inode, void * buf, int
 
 
 /*
-* @ brief: 
-* @ parameters: 
-* @ return: (for convience) the absolute index of the 
+* @ brief: allocates the file's contiguous_db_to_alloc'th block, and the indirect/doubly-indirect blocks that lead to it if they're new
+* @ parameters: backing cache pointer, inode of the file, which of its blocks to allocate, and the data block index we'd like
+*               it at (KTFS_NOGOAL for anywhere). new index blocks take the goal and the data block goes right after them
+* @ return: (for convience) the absolute index of the new data block, or a negative error code
 */
-int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_t contiguous_db_to_alloc){
+int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_t contiguous_db_to_alloc, uint32_t goal){
     trace("%s(cache=%p, inode=%p, contiguous_db_to_alloc=%u)\n", __func__, cache, inode, contiguous_db_to_alloc);
     int alloc_db_idx;
     void * blkptr;
 
+    //an index block needs allocating when we're past the end of the file and at the first block it maps (the index
+    //pointing at it is whatever was on disk then), or when the index pointing at it is a hole (see KTFS_HOLE), which
+    //can be anywhere in the file
+    int past_end = contiguous_db_to_alloc >= (inode->size + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+
     //one by one checks needs for direct, indirect, and dindirect allocation
     if (contiguous_db_to_alloc < KTFS_NUM_DIRECT_DATA_BLOCKS){
-        alloc_db_idx = ktfs_find_and_use_free_db_slot(cache);
+        alloc_db_idx = ktfs_find_and_use_free_db_slot(cache, goal);
         trace("alloc_db_idx: %d\n" , alloc_db_idx);
         if (alloc_db_idx <0) return alloc_db_idx;
         inode->block[contiguous_db_to_alloc] = alloc_db_idx;  
@@ -297,17 +509,18 @@ int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_
     
 	//kprintf("reached indirect blocks in %s\n", __func__);
 
-        if (contiguous_db_to_alloc == 0){ //case that its the first block we need to store in the indirects, so there isn't already a datablock indirection
-            alloc_db_idx = ktfs_find_and_use_free_db_slot(cache);
+        if ((past_end && contiguous_db_to_alloc == 0) || inode->indirect == KTFS_HOLE){ //case that there isn't already a datablock indirection
+            alloc_db_idx = ktfs_alloc_index_block(cache, goal);
 			trace("alloc_db_idx: %d\n", alloc_db_idx);
             if (alloc_db_idx < 0){
-				kprintf("ktfs_find_and_use_free_db_slot returned error: %s\n", error_name(alloc_db_idx));
+				kprintf("ktfs_alloc_index_block returned error: %s\n", error_name(alloc_db_idx));
 				return alloc_db_idx;
 			}
             inode->indirect = alloc_db_idx;
+            goal = alloc_db_idx + 1;
         }
         
-        int new_indir_blk = ktfs_find_and_use_free_db_slot(cache);//allocate new indirect blk (leaf)
+        int new_indir_blk = ktfs_find_and_use_free_db_slot(cache, goal);//allocate new indirect blk (leaf)
 		
 		kprintf("new_indir_blk %d\n", new_indir_blk);
         if (new_indir_blk < 0){
@@ -316,7 +529,7 @@ int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_
         }
 		
         //write new pointer into the indirect blk
-        if (cache_get_block(cache, (inode->indirect + ktfs->data_block_start) * KTFS_BLKSZ, &blkptr)< 0){
+        if (cache_get_block_flags(cache, (inode->indirect + ktfs->data_block_start) * KTFS_BLKSZ, CACHE_META, &blkptr)< 0){
             kprintf("cache_get_block returned a negative value\n");
             return -EINVAL;
         }
@@ -335,110 +548,274 @@ int ktfs_alloc_datablock(struct cache* cache, struct ktfs_inode * inode, uint32_
 
 	//kprintf("reached dindirect blocks in %s\n", __func__);
 
+    uint32_t lvl_one_idx = contiguous_db_to_alloc/(128*128);
+    uint32_t lvl_one_db = inode->dindirect[lvl_one_idx]; //the inode is packed, so work on a copy
+    uint32_t lvl_one_slot = (contiguous_db_to_alloc%(128*128))/128;
     int lvl_two_alloc_db = -1;
     int lvl_one_alloc_db = -1;
 
-    if (contiguous_db_to_alloc % 128 == 0){ //means we have to AT LEAST do the second level of allocation
-        if (contiguous_db_to_alloc % (128*128) ==0){
-            lvl_one_alloc_db = ktfs_find_and_use_free_db_slot(cache);
-            if (lvl_one_alloc_db < 0){
-                trace("error from find and use free db");
-                return lvl_one_alloc_db;
-            }
-            inode->dindirect[contiguous_db_to_alloc/(128*128)] = lvl_one_alloc_db;
-        }else lvl_one_alloc_db = inode->dindirect[contiguous_db_to_alloc/(128*128)]; //= lvl_two_alloc_db;
-        
-        lvl_two_alloc_db = ktfs_find_and_use_free_db_slot(cache);
-        cache_get_block(cache, (ktfs->data_block_start+ lvl_one_alloc_db)*KTFS_BLKSZ, &blkptr);
-        ((uint32_t *)blkptr)[(contiguous_db_to_alloc%(128*128))/128] = lvl_one_alloc_db;
-        cache_release_block(cache, blkptr, 1);
+    if ((past_end && contiguous_db_to_alloc % (128*128) == 0) || lvl_one_db == KTFS_HOLE){
+        lvl_one_alloc_db = ktfs_alloc_index_block(cache, goal);
+        if (lvl_one_alloc_db < 0){
+            trace("error from ktfs_alloc_index_block");
+            return lvl_one_alloc_db;
+        }
+        inode->dindirect[lvl_one_idx] = lvl_one_alloc_db;
+        goal = lvl_one_alloc_db + 1;
     }
-    else{
-        lvl_one_alloc_db = inode->dindirect[contiguous_db_to_alloc/(128*128)];
-        cache_get_block(cache, (ktfs->data_block_start + lvl_one_alloc_db)*KTFS_BLKSZ, &blkptr);
-        lvl_two_alloc_db = ((uint32_t *)blkptr)[(contiguous_db_to_alloc%(128*128))/128];
-        cache_release_block(cache, blkptr, 0);
+    else lvl_one_alloc_db = lvl_one_db;
+
+    if (cache_get_block_flags(cache, (ktfs->data_block_start + lvl_one_alloc_db)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0) return -EIO;
+    lvl_two_alloc_db = ((uint32_t *)blkptr)[lvl_one_slot];
+    if ((past_end && contiguous_db_to_alloc % 128 == 0) || (uint32_t)lvl_two_alloc_db == KTFS_HOLE){ //means we have to do the second level of allocation
+        lvl_two_alloc_db = ktfs_alloc_index_block(cache, goal);
+        if (lvl_two_alloc_db < 0){
+            cache_release_block(cache, blkptr, 0);
+            return lvl_two_alloc_db;
+        }
+        goal = lvl_two_alloc_db + 1;
+        ((uint32_t *)blkptr)[lvl_one_slot] = lvl_two_alloc_db;
+        cache_release_block(cache, blkptr, 1);
     }
+    else cache_release_block(cache, blkptr, 0);
 
     //at this point we will always have a lvl2 block
 
-    int new_leaf_db = ktfs_find_and_use_free_db_slot(cache);
+    int new_leaf_db = ktfs_find_and_use_free_db_slot(cache, goal);
+    if (new_leaf_db < 0) return new_leaf_db;
 
-    cache_get_block(cache, (lvl_two_alloc_db+ ktfs->data_block_start)*KTFS_BLKSZ, &blkptr);
+    if (cache_get_block_flags(cache, (lvl_two_alloc_db+ ktfs->data_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0) return -EIO;
     ((uint32_t *)blkptr)[contiguous_db_to_alloc%128] = new_leaf_db;
     cache_release_block(cache, blkptr, 1);
-    return new_leaf_db; 
+    return new_leaf_db + ktfs->data_block_start; //absolute, like the other two cases
 }
 
+/*
+* @ brief: claims a data block for an index block (the indirect block, or either level of the doubly-indirect tree) and
+*          makes every index in it a hole, so the blocks it maps are holes until they're allocated
+* @ parameters: backing cache pointer, and the data block we'd like (as for ktfs_find_and_use_free_db_slot)
+* @ return: the DATABLOCK IDX (not absolute) of the new index block, or negative error code
+*/
+static int ktfs_alloc_index_block(struct cache* cache, uint32_t goal){
+    int db = ktfs_find_and_use_free_db_slot(cache, goal);
+    void * blkptr;
+
+    if (db < 0) return db;
+    if (cache_get_block_flags(cache, (db + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0){
+        ktfs_free_db_slot(cache, db);
+        return -EIO;
+    }
+    memset(blkptr, 0xFF, KTFS_BLKSZ); //every index KTFS_HOLE
+    cache_release_block(cache, blkptr, 1);
+    return db;
+}
 
-//finds AND CLAIMS the first free datablock on the bitmap. also marks the slot as used before returning
+
+//finds AND CLAIMS a free datablock on the bitmap. also marks the slot as used before returning
 //simply a helper function for ktfs_alloc_datablock, since I'd have to write the smae code over and over again for otherwise
 //NOTE: RETURNS THE DATABLOCK IDX NOT ABSOLUTE IDX
 //note that if this function returned a negative, the allocation should have ABSOLUTELY NEVER HAPPENED
-int ktfs_find_and_use_free_db_slot(struct cache * cache){
-
-    void * blkptr;
+//goal is the data block we'd like (the search for a free one starts there), or KTFS_NOGOAL
+int ktfs_find_and_use_free_db_slot(struct cache * cache, uint32_t goal){
+    int db = ktfs_bitmap_claim(cache, &ktfs->db_map, goal);
 
+    if (db < 0) return db;
+    trace("%s, claims dbs: %d\n", __func__, db);
+    return db;
+}
 
-    int n_db = (ktfs->block_cnt - ktfs->data_block_start);
-    int curr_db = 0;
 
-    while(curr_db < n_db){
+//finds AND CLAIMS a free inode on the inode bitmap. also marks the slot as used before returning
+//NOTE: RETURNS THE INODE NUMBER
+int ktfs_find_and_use_free_inode_slot(struct cache * cache){
+	trace("ktfs_find_and_use_free_inode_slots\n");
+    int inode = ktfs_bitmap_claim(cache, &ktfs->ino_map, KTFS_NOGOAL);
 
-        int ndb_per_cycle = MIN(KTFS_BLKSZ*8, n_db - curr_db);
+    return (inode == -ENODATABLKS) ? -ENOINODEBLKS : inode;
+}
 
-        if (cache_get_block(cache, (ktfs->bitmap_block_start + curr_db/(KTFS_BLKSZ*8))*KTFS_BLKSZ, &blkptr)<0) {trace("wtf"); return -900;}
-        
-        for (int i = 0; i < ndb_per_cycle; i++){
-            int cycle_offset = i / 8;
-            int loop_offset = i % 8;
-            if((((char *)blkptr)[cycle_offset] & (1<< loop_offset))== 0){
-                if (i==20) trace("there is no way we can be here\n");
-                ((char *)blkptr)[cycle_offset] |= (1<<loop_offset);
-                cache_release_block(cache, blkptr, 1);
-				
-    			trace("%s, claims dbs: %d\n", __func__, curr_db);
-                return curr_db;
-            }
-			curr_db++;
+/*
+* @ brief: searches a bitmap for a clear bit and sets it
+* @ parameters: backing cache pointer, the bitmap's allocator state, and where to start looking (KTFS_NOGOAL for the hint)
+* @ return: index of the bit claimed, -ENODATABLKS if they're all set (whichever bitmap it is), or another negative error code
+*
+* next fit: the search starts at the goal or the hint (one past the last bit handed out without a goal) and wraps
+* around, so an append doesn't rescan everything in front of it. bitmap blocks whose free count is 0 are skipped without touching
+* the cache, and the ones we do look at are read 64 bits at a time
+*/
+static int ktfs_bitmap_claim(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t goal){
+    void * blkptr;
+    uint32_t n_bmblks = (map->nbits + KTFS_BITS_PER_BLK - 1)/KTFS_BITS_PER_BLK;
+    uint32_t hint = (goal < map->nbits) ? goal : (map->hint < map->nbits) ? map->hint : 0;
+
+    //one extra pass over the hint's bitmap block, for the bits in front of the hint
+    for (uint32_t k = 0; k <= n_bmblks; k++){
+        uint32_t bmblk = (hint/KTFS_BITS_PER_BLK + k) % n_bmblks;
+        uint32_t first_bit = bmblk*KTFS_BITS_PER_BLK;
+        uint32_t nwords = (MIN(KTFS_BITS_PER_BLK, map->nbits - first_bit) + 63)/64;
+        uint32_t w = (k == 0) ? (hint%KTFS_BITS_PER_BLK)/64 : 0;
+
+        if (map->free[bmblk] == 0) continue;
+        if (cache_get_block_flags(cache, (map->start + bmblk)*KTFS_BLKSZ, CACHE_META, &blkptr)<0) return -EIO;
+
+        for (; w < nwords; w++){
+            uint64_t free_bits = ~((uint64_t *)blkptr)[w];
+            if (k == 0 && w == (hint%KTFS_BITS_PER_BLK)/64) free_bits &= ~0ULL << (hint%64); //behind the hint, left for the wrap-around
+            if (free_bits == 0) continue;
+
+            uint32_t idx = first_bit + w*64 + ktfs_ctz64(free_bits);
+            if (idx >= map->nbits) break; //the tail of the last bitmap block, past the end of the image
+            ((uint64_t *)blkptr)[w] |= 1ULL << (idx%64);
+            cache_release_block(cache, blkptr, 1);
+            map->free[bmblk]--;
+            if (goal >= map->nbits) map->hint = idx + 1; //a goal is somebody's own spot, the hint is for everyone else
+            return idx;
         }
         cache_release_block(cache, blkptr, 0);
-
-            //curr_db+= ndb_per_cycle;
     }
 
     return -ENODATABLKS;
 }
 
+/*
+* @ brief: looks for a run of clear bits without claiming any of it
+* @ parameters: backing cache pointer, the bitmap's allocator state, where to start looking (KTFS_NOGOAL for the hint), and
+*               the length we'd like
+* @ return: start of the first run of at least want bits from "from" on (wrapping around), else the start of the longest
+*           run there is, KTFS_NOGOAL if there are none or a bitmap block couldn't be read
+*/
+static uint32_t ktfs_bitmap_find_run(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t from, uint32_t want){
+    void * blkptr;
+    uint32_t n_bmblks = (map->nbits + KTFS_BITS_PER_BLK - 1)/KTFS_BITS_PER_BLK;
+    uint32_t best = KTFS_NOGOAL, best_len = 0;
+    uint32_t run = KTFS_NOGOAL, run_len = 0;
+
+    if (from >= map->nbits) from = (map->hint < map->nbits) ? map->hint : 0;
+
+    //same walk as claim: from "from" to the end, then from the start back up to "from". runs don't carry across a
+    //full bitmap block or the wrap from the last bit to the first
+    for (uint32_t k = 0; k <= n_bmblks; k++){
+        uint32_t bmblk = (from/KTFS_BITS_PER_BLK + k) % n_bmblks;
+        uint32_t first_bit = bmblk*KTFS_BITS_PER_BLK;
+        uint32_t i = (k == 0) ? from%KTFS_BITS_PER_BLK : 0;
+        uint32_t end = (k == n_bmblks) ? from%KTFS_BITS_PER_BLK : MIN(KTFS_BITS_PER_BLK, map->nbits - first_bit);
+
+        if ((k > 0 && bmblk == 0) || map->free[bmblk] == 0) run_len = 0;
+        if (map->free[bmblk] == 0 || i >= end) continue;
+        if (cache_get_block_flags(cache, (map->start + bmblk)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return KTFS_NOGOAL;
+
+        while (i < end){
+            uint64_t word = ((uint64_t *)blkptr)[i/64];
+
+            if (i%64 == 0 && end - i >= 64 && (word == 0 || word == ~0ULL)){ //whole words at a time where we can
+                if (word == ~0ULL) run_len = 0;
+                else {
+                    if (run_len == 0) run = first_bit + i;
+                    run_len += 64;
+                }
+                i += 64;
+            }
+            else {
+                if (word & (1ULL << (i%64))) run_len = 0;
+                else {
+                    if (run_len == 0) run = first_bit + i;
+                    run_len++;
+                }
+                i++;
+            }
+            if (run_len > best_len){
+                best = run;
+                best_len = run_len;
+            }
+            if (run_len >= want){
+                cache_release_block(cache, blkptr, 0);
+                return run;
+            }
+        }
+        cache_release_block(cache, blkptr, 0);
+    }
+    return best;
+}
 
-//finds AND CLAIMS the first free datablock on the bitmap. also marks the slot as used before returning
-//simply a helper function for ktfs_alloc_datablock, since I'd have to write the smae code over and over again for otherwise
-//NOTE: RETURNS THE DATABLOCK IDX NOT ABSOLUTE IDX
-int ktfs_find_and_use_free_inode_slot(struct cache * cache){
-	trace("ktfs_find_and_use_free_inode_slots\n");
+/*
+* @ brief: checks whether n bits from start on are all clear
+* @ parameters: backing cache pointer, the bitmap's allocator state, first bit, number of bits
+* @ return: 1 if they are (and all exist), 0 if not or a bitmap block couldn't be read
+*/
+static int ktfs_bitmap_run_is_free(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t start, uint32_t n){
+    void * blkptr = NULL;
+    uint32_t bmblk = UINT32_MAX;
+
+    if (start >= map->nbits || n > map->nbits - start) return 0;
+    for (uint32_t i = start; i < start + n; i++){
+        if (i/KTFS_BITS_PER_BLK != bmblk){
+            if (blkptr != NULL) cache_release_block(cache, blkptr, 0);
+            blkptr = NULL;
+            bmblk = i/KTFS_BITS_PER_BLK;
+            if (map->free[bmblk] == 0 || cache_get_block_flags(cache, (map->start + bmblk)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return 0;
+        }
+        if (((uint8_t *)blkptr)[(i%KTFS_BITS_PER_BLK)/8] & (1 << (i%8))){
+            cache_release_block(cache, blkptr, 0);
+            return 0;
+        }
+    }
+    if (blkptr != NULL) cache_release_block(cache, blkptr, 0);
+    return 1;
+}
+
+/*
+* @ brief: clears a bit in a bitmap
+* @ parameters: backing cache pointer, the bitmap's allocator state, index of the bit
+* @ return: 0 if it was set, 1 if it was already clear, negative error code if idx is out of range or the bitmap couldn't be read
+*/
+static int ktfs_bitmap_release(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t idx){
     void * blkptr;
+    int was_clear;
+
+    if (idx >= map->nbits) return -EINVAL;
+    if (cache_get_block_flags(cache, (map->start + idx/KTFS_BITS_PER_BLK)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0) return -EIO;
+    was_clear = (((uint8_t *)blkptr)[(idx%KTFS_BITS_PER_BLK)/8] & (1 << (idx%8))) == 0;
+    ((uint8_t *)blkptr)[(idx%KTFS_BITS_PER_BLK)/8] &= ~(1 << (idx%8));
+    cache_release_block(cache, blkptr, !was_clear);
+    if (!was_clear) map->free[idx/KTFS_BITS_PER_BLK]++;
+    return was_clear;
+}
 
-    cache_get_block(ktfs->cache_ptr, ktfs->inode_bitmap_block_start*KTFS_BLKSZ, &blkptr);
+/*
+* @ brief: sets up a bitmap's allocator state, counting the free bits in each of its blocks
+* @ parameters: backing cache pointer, the state to fill in, absolute block index of the first bitmap block, number of bits in use
+* @ return: 0 on success, negative error code if a bitmap block couldn't be read
+*/
+static int ktfs_bitmap_init(struct cache* cache, struct ktfs_bitmap_state* map, uint32_t start, uint32_t nbits){
+    uint32_t n_bmblks = (nbits + KTFS_BITS_PER_BLK - 1)/KTFS_BITS_PER_BLK;
+    void * blkptr;
+    int retval;
 
-    //NOTE HARDCODED TO 512 instead of using ktfs_max_inode_num;
-    for (int i = 0; i < 512; i++){
-        int index = i / 8;
-        int offset = i % 8;
-        if((((char * )blkptr)[index] & (1<< offset))== 0){
-            ((char *)blkptr)[index] |= (1<<offset);
-            cache_release_block(ktfs->cache_ptr, blkptr, 1);   
-            return i;
+    map->start = start;
+    map->nbits = nbits;
+    map->hint = 0;
+    map->free = kcalloc(n_bmblks ? n_bmblks : 1, sizeof(uint16_t));
+    for (uint32_t b = 0; b < n_bmblks; b++){
+        uint32_t blk_bits = MIN(KTFS_BITS_PER_BLK, nbits - b*KTFS_BITS_PER_BLK);
+
+        retval = cache_get_block_flags(cache, (start + b)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr);
+        if (retval < 0) return retval;
+        map->free[b] = blk_bits;
+        for (uint32_t w = 0; w < (blk_bits + 63)/64; w++){
+            uint64_t used = ((uint64_t *)blkptr)[w];
+            if (blk_bits - w*64 < 64) used &= (1ULL << (blk_bits - w*64)) - 1; //bits past the end of the image
+            map->free[b] -= ktfs_popcount64(used);
         }
-
+        cache_release_block(cache, blkptr, 0);
     }
-    cache_release_block(ktfs->cache_ptr, blkptr, 0);
-    return -ENOINODEBLKS;
+    return 0;
 }
 
 /*
 * @ brief: returns the ABSOLUTE block index inside the backing device. where (0 is the index of the superblock)
 * @ parameters: pointer to the backing cache struct pointer to the inode of the file we're trying to traverse, and the index of which one of the contiguous datablocks we are trying to access
 * @ return: negative value on failure, ABSOLUTE block index of the datablock we were looking for at the 512 aligned position that we specified as contiguous_db_index arguement
+*           or 0 if it's a hole (see KTFS_HOLE). the superblock is never a file's block
 */
 int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, uint32_t contiguous_db_index){
     trace("%s(cache=%p, inode=%p, contiguous_db_index=%u)\n", __func__, cache, inode, contiguous_db_index);
@@ -451,6 +828,7 @@ int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, u
     //logic for returning the correct absolute block. 
 
     if (contiguous_db_index < KTFS_NUM_DIRECT_DATA_BLOCKS){
+        if (inode->block[contiguous_db_index] == KTFS_HOLE) return 0;
         return inode->block[contiguous_db_index] + ktfs->data_block_start;
     }
 
@@ -459,16 +837,17 @@ int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, u
 
     //there is 128 indirect indexes
     if (contiguous_db_index < 128){
+        if (inode->indirect == KTFS_HOLE) return 0;
 		
-        retval = cache_get_block(ktfs->cache_ptr, (inode->indirect+ktfs->data_block_start)*KTFS_BLKSZ, (void **)&indirect);
+        retval = cache_get_block_flags(ktfs->cache_ptr, (inode->indirect+ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&indirect);
         if (retval < 0){ 
             trace("cache_get_block failed");
-            cache_release_block(ktfs->cache_ptr, indirect, 0);
             return retval;
         }
 
         uint32_t indirect_index = ((uint32_t *)indirect)[contiguous_db_index];
         cache_release_block(ktfs->cache_ptr, indirect, 0);
+        if (indirect_index == KTFS_HOLE) return 0;
         return indirect_index + ktfs->data_block_start;
     }
 
@@ -477,27 +856,28 @@ int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, u
 	trace("welcome to dindirects\n");
     //dindirects now
     if (contiguous_db_index< 2*128*128){
+        if (inode->dindirect[contiguous_db_index/(128*128)] == KTFS_HOLE) return 0;
 
-        retval = cache_get_block(ktfs->cache_ptr, (inode->dindirect[contiguous_db_index/(128*128)]+ktfs->data_block_start)*KTFS_BLKSZ, (void **)&indirect);
+        retval = cache_get_block_flags(ktfs->cache_ptr, (inode->dindirect[contiguous_db_index/(128*128)]+ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&indirect);
         if (retval < 0){ 
             trace("ktfs_get_block_absolute_idx failed when trying to execute cache_get_block for a double indirect (first time)");
-            cache_release_block(ktfs->cache_ptr,indirect, 0);
             return retval;
         }        
 
         uint32_t indirect_index = ((uint32_t *)indirect)[(contiguous_db_index%(128*128))/128];
 
         cache_release_block(ktfs->cache_ptr, indirect,0);
+        if (indirect_index == KTFS_HOLE) return 0;
 
-        retval = cache_get_block(ktfs->cache_ptr, (ktfs->data_block_start + indirect_index)*KTFS_BLKSZ, (void **)&dindirect);
+        retval = cache_get_block_flags(ktfs->cache_ptr, (ktfs->data_block_start + indirect_index)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&dindirect);
         if (retval < 0){ 
             trace("ktfs_get_block_absolute_idx failed when trying to execute cache_get_block for a double indirect (second time)");
-            cache_release_block(ktfs->cache_ptr, dindirect, 0);
             return retval;
         }
         
         uint32_t dindirect_index = ((uint32_t *)dindirect)[contiguous_db_index%128];
         cache_release_block(ktfs->cache_ptr, (void *)dindirect, 0);
+        if (dindirect_index == KTFS_HOLE) return 0;
         
         dindirect_index += ktfs->data_block_start; //makes it the absolute offset of the first layer of indirection
 
@@ -512,6 +892,529 @@ int ktfs_get_block_absolute_idx(struct cache* cache, struct ktfs_inode* inode, u
 
 }
 
+/*
+* @ brief: ktfs_get_block_absolute_idx for an open file, through the file's block map cache. a miss copies the whole index
+*          block that maps the block asked for, so the next 127 lookups past it don't touch the cache at all. a hole in
+*          the copy is looked up again, since a store through another open of the file may have filled it since
+* @ parameters: the open file, and which of its blocks we want
+* @ return: negative value on failure, ABSOLUTE block index of that block, or 0 if it's a hole
+*/
+static int ktfs_file_block_idx(struct ktfs_file_uio* fu, uint32_t contiguous_db_index){
+    struct ktfs_inode * inode = &fu->file->inode_data;
+    uint32_t nblks = (inode->size + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+    uint32_t first, rel;
+    int index_blk;
+    void * blkptr;
+
+    if (contiguous_db_index < KTFS_NUM_DIRECT_DATA_BLOCKS) return ktfs_get_block_absolute_idx(ktfs->cache_ptr, inode, contiguous_db_index);
+    if (fu->blkmap != NULL && contiguous_db_index - fu->blkmap_first < fu->blkmap_valid){
+        if (fu->blkmap[contiguous_db_index - fu->blkmap_first] == KTFS_HOLE) return ktfs_get_block_absolute_idx(ktfs->cache_ptr, inode, contiguous_db_index);
+        return fu->blkmap[contiguous_db_index - fu->blkmap_first] + ktfs->data_block_start;
+    }
+
+    //past the end of the file the index block may still be filling in, and without a buffer we can't copy it
+    if (contiguous_db_index >= nblks || contiguous_db_index >= KTFS_MAX_FILE_SIZE/KTFS_BLKSZ) return ktfs_get_block_absolute_idx(ktfs->cache_ptr, inode, contiguous_db_index);
+    if (fu->blkmap == NULL && (fu->blkmap = kmalloc(KTFS_BLKSZ)) == NULL) return ktfs_get_block_absolute_idx(ktfs->cache_ptr, inode, contiguous_db_index);
+
+    //find the index block: the indirect block, or the second level block the first level doubly-indirect one points to
+    rel = contiguous_db_index - KTFS_NUM_DIRECT_DATA_BLOCKS;
+    first = KTFS_NUM_DIRECT_DATA_BLOCKS + rel/128*128;
+    if (rel < 128) index_blk = inode->indirect;
+    else if (inode->dindirect[(rel - 128)/(128*128)] == KTFS_HOLE) index_blk = KTFS_HOLE;
+    else {
+        rel -= 128;
+        if (cache_get_block_flags(ktfs->cache_ptr, (inode->dindirect[rel/(128*128)] + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+        index_blk = ((uint32_t *)blkptr)[(rel%(128*128))/128];
+        cache_release_block(ktfs->cache_ptr, blkptr, 0);
+    }
+
+    fu->blkmap_valid = 0; //in case the read fails
+    if ((uint32_t)index_blk == KTFS_HOLE) memset(fu->blkmap, 0xFF, KTFS_BLKSZ); //all 128 are holes
+    else {
+        if (cache_get_block_flags(ktfs->cache_ptr, (index_blk + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+        memcpy(fu->blkmap, blkptr, KTFS_BLKSZ);
+        cache_release_block(ktfs->cache_ptr, blkptr, 0);
+    }
+    fu->blkmap_first = first;
+    fu->blkmap_valid = MIN(128, nblks - first);
+
+    if (fu->blkmap[contiguous_db_index - first] == KTFS_HOLE) return 0;
+    return fu->blkmap[contiguous_db_index - first] + ktfs->data_block_start;
+}
+
+/*
+* @ brief: gives a hole in an open file (see KTFS_HOLE) a block of its own, for a store into it. what's in the block is
+*          whatever was on disk, so the caller zeroes the part of it the store doesn't cover. caller holds the file's lock
+* @ parameters: the open file, which of its blocks, and the data block we'd like it to be (KTFS_NOGOAL for the one after
+*               the file's block before it, if that isn't a hole too)
+* @ return: negative value on failure, ABSOLUTE block index of the new block
+*/
+static int ktfs_file_fill_hole(struct ktfs_file_uio* fu, uint32_t contiguous_db_index, uint32_t goal){
+    int prev, blk;
+
+    if (goal == KTFS_NOGOAL && contiguous_db_index > 0){
+        prev = ktfs_file_block_idx(fu, contiguous_db_index - 1);
+        if (prev > 0) goal = prev - ktfs->data_block_start + 1;
+    }
+    blk = ktfs_alloc_datablock(ktfs->cache_ptr, &fu->file->inode_data, contiguous_db_index, goal);
+    if (blk < 0) return blk;
+    fu->file->inode_dirty = 1;
+
+    //other opens of the file find out when they look it up again (see ktfs_file_block_idx)
+    if (fu->blkmap != NULL && contiguous_db_index - fu->blkmap_first < fu->blkmap_valid)
+        fu->blkmap[contiguous_db_index - fu->blkmap_first] = blk - ktfs->data_block_start;
+    return blk;
+}
+
+/*
+* @ brief: grows an open file to end bytes by leaving holes (see KTFS_HOLE) rather than writing zeros. an index that only
+*          maps new blocks becomes a hole itself, so however far the file grows this touches the inode, the rest of the
+*          file's last block, and at most the three index blocks its old end is in. nothing is allocated. caller holds
+*          the file's lock
+* @ parameters: the open file, and its new size (clamped to KTFS_MAX_FILE_SIZE). the caller checks it's no smaller
+* @ return: 0 on success, negative error code if a block couldn't be read (the file keeps its old size then)
+*/
+static int ktfs_file_setend(struct ktfs_file_uio* fu, uint32_t end){
+    struct ktfs_inode * inode = &fu->file->inode_data;
+    uint32_t old_nblks = (inode->size + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+    uint32_t new_nblks;
+    uint32_t from, to;
+    void * blkptr;
+    int retval;
+
+    end = MIN(end, KTFS_MAX_FILE_SIZE);
+    new_nblks = (end + KTFS_BLKSZ - 1)/KTFS_BLKSZ;
+
+    //past the old end the last block holds whatever was on disk, and that now has to read as zeros
+    if (inode->size%KTFS_BLKSZ != 0){
+        retval = ktfs_file_block_idx(fu, inode->size/KTFS_BLKSZ);
+        if (retval < 0) return retval;
+        if (retval > 0){
+            if (cache_get_block(ktfs->cache_ptr, (unsigned long long)retval*KTFS_BLKSZ, &blkptr) < 0) return -EIO;
+            memset((char *)blkptr + inode->size%KTFS_BLKSZ, 0, KTFS_BLKSZ - inode->size%KTFS_BLKSZ);
+            cache_release_block(ktfs->cache_ptr, blkptr, 1);
+        }
+    }
+
+    for (uint32_t i = old_nblks; i < MIN(new_nblks, KTFS_NUM_DIRECT_DATA_BLOCKS); i++) inode->block[i] = KTFS_HOLE;
+
+    //the indirect block: a hole if the file didn't reach it, otherwise the rest of it is
+    if (new_nblks > KTFS_NUM_DIRECT_DATA_BLOCKS){
+        from = MAX(old_nblks, KTFS_NUM_DIRECT_DATA_BLOCKS) - KTFS_NUM_DIRECT_DATA_BLOCKS;
+        to = MIN(new_nblks - KTFS_NUM_DIRECT_DATA_BLOCKS, 128);
+        if (from == 0) inode->indirect = KTFS_HOLE;
+        else if ((retval = ktfs_index_punch(ktfs->cache_ptr, inode->indirect, from, to)) < 0) return retval;
+    }
+
+    //each doubly-indirect tree the same way, down both levels
+    for (int d = 0; d < KTFS_NUM_DINDIRECT_BLOCKS; d++){
+        uint32_t base = KTFS_NUM_DIRECT_DATA_BLOCKS + 128 + d*128*128;
+
+        if (new_nblks <= base) break;
+        if (old_nblks >= base + 128*128) continue;
+        from = MAX(old_nblks, base) - base;
+        to = MIN(new_nblks - base, 128*128);
+        if (from == 0){
+            inode->dindirect[d] = KTFS_HOLE;
+            continue;
+        }
+        if (inode->dindirect[d] == KTFS_HOLE) continue;
+
+        if (cache_get_block_flags(ktfs->cache_ptr, (inode->dindirect[d] + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0) return -EIO;
+        if (from%128 != 0){
+            retval = ktfs_index_punch(ktfs->cache_ptr, ((uint32_t *)blkptr)[from/128], from%128, MIN(to - from/128*128, 128));
+            if (retval < 0){
+                cache_release_block(ktfs->cache_ptr, blkptr, 0);
+                return retval;
+            }
+        }
+        for (uint32_t j = (from + 127)/128; j < (to + 127)/128; j++) ((uint32_t *)blkptr)[j] = KTFS_HOLE;
+        cache_release_block(ktfs->cache_ptr, blkptr, 1);
+    }
+
+    inode->size = end;
+    fu->file->inode_dirty = 1;
+    return 0;
+}
+
+/*
+* @ brief: makes indices [from, to) of an index block holes (see KTFS_HOLE)
+* @ parameters: backing cache pointer, DATABLOCK IDX of the index block (KTFS_HOLE if it's a hole already, and it's left
+*               alone), and the range
+* @ return: 0 on success, negative error code if the block couldn't be read
+*/
+static int ktfs_index_punch(struct cache* cache, uint32_t index_db, uint32_t from, uint32_t to){
+    void * blkptr;
+
+    if (index_db == KTFS_HOLE || from >= to) return 0;
+    if (cache_get_block_flags(cache, (index_db + ktfs->data_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr) < 0) return -EIO;
+    for (uint32_t i = from; i < to; i++) ((uint32_t *)blkptr)[i] = KTFS_HOLE;
+    cache_release_block(cache, blkptr, 1);
+    return 0;
+}
+
+/*
+* @ brief: puts a file's cached inode back in its slot of the inode table, if it has changed since it was read in or
+*          last written back
+* @ parameters: the file
+* @ return: 0 on success, negative error code if the inode block couldn't be had (the inode stays dirty)
+*/
+static int ktfs_inode_writeback(struct ktfs_file* file){
+    uint16_t inode_num = file->dentry.inode;
+    void * blkptr;
+    int retval;
+
+    //a store in progress may have changed the inode only partway, and would set inode_dirty again too soon
+    lock_acquire(&file->lock);
+    if (!file->inode_dirty){
+        lock_release(&file->lock);
+        return 0;
+    }
+    retval = cache_get_block_flags(ktfs->cache_ptr, (inode_num/KTFS_NUM_INODES_IN_BLOCK + ktfs->inode_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr);
+    if (retval == 0){
+        memcpy((struct ktfs_inode *)blkptr + inode_num%KTFS_NUM_INODES_IN_BLOCK, &file->inode_data, KTFS_INOSZ);
+        cache_release_block(ktfs->cache_ptr, blkptr, 1);
+        file->inode_dirty = 0;
+    }
+    lock_release(&file->lock);
+    return retval;
+}
+
+/**
+ * @brief finds a file's dentry slot by name. a flat directory goes through the name index: a name that isn't there
+ * costs one short chain walk, same as one that is, plus a dentry read for each slot in it whose hash matches and that
+ * has no record. a hashed one is read (see ktfs_hashdir_lookup)
+ * @param name file name
+ * @param dentry filled in with the file's dentry if it's found (may be NULL)
+ * @return dentry slot of the file, -ENOENT if there's no such file, other negative error code if a directory block
+ * couldn't be read
+ */
+static int ktfs_name_lookup(const char* name, struct ktfs_dir_entry* dentry){
+    unsigned int hash = ktfs_name_hash(name);
+    struct ktfs_dir_entry slot_dentry;
+    struct ktfs_file * file;
+    int retval;
+
+    if (ktfs->hashdir) return ktfs_hashdir_lookup(name, dentry);
+
+    for (int slot = ktfs->name_heads[hash & (ktfs->name_nslots - 1)]; slot != KTFS_NOFILE; slot = ktfs->slot_next[slot]){
+        if (ktfs->slot_hash[slot] != hash) continue;
+        file = ktfs_file_find(slot);
+        if (file != NULL) slot_dentry = file->dentry;
+        else {
+            retval = ktfs_dentry_read(slot, &slot_dentry);
+            if (retval < 0) return retval;
+        }
+        if (strncmp(name, slot_dentry.name, KTFS_MAX_FILENAME_LEN) == 0){
+            if (dentry != NULL) *dentry = slot_dentry;
+            return slot;
+        }
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief adds a dentry slot to the name index
+ * @param slot dentry slot, below name_nslots
+ * @param hash ktfs_name_hash of the name in it
+ */
+static void ktfs_name_insert(int slot, unsigned int hash){
+    int b = hash & (ktfs->name_nslots - 1);
+    ktfs->slot_hash[slot] = hash;
+    ktfs->slot_next[slot] = ktfs->name_heads[b];
+    ktfs->name_heads[b] = slot;
+}
+
+/**
+ * @brief takes a dentry slot out of the name index
+ * @param slot dentry slot
+ */
+static void ktfs_name_remove(int slot){
+    int * link = &ktfs->name_heads[ktfs->slot_hash[slot] & (ktfs->name_nslots - 1)];
+    while (*link != slot) link = &ktfs->slot_next[*link];
+    *link = ktfs->slot_next[slot];
+}
+
+/**
+ * @brief makes a name index with room for nslots dentry slots and moves the first nfiles slots of the old one (if
+ * there is one) over. the chains are rebuilt from the slot hashes, so no directory blocks are read
+ * @param nslots slots the new index has, a power of two
+ * @param nfiles dentry slots in use
+ * @return 0 on success, -ENOMEM if there aren't the pages for it (the old index is kept)
+ */
+static int ktfs_name_index_resize(int nslots, int nfiles){
+    int npages = ROUND_UP(nslots * (sizeof(uint32_t) + 2 * sizeof(int)), PAGE_SIZE) / PAGE_SIZE;
+    uint32_t * old_hash = ktfs->slot_hash;
+    void * pages;
+
+    pages = alloc_phys_pages(npages);
+    if (pages == NULL) return -ENOMEM;
+
+    ktfs->slot_hash = pages;
+    ktfs->slot_next = (int *)(ktfs->slot_hash + nslots);
+    ktfs->name_heads = ktfs->slot_next + nslots;
+    ktfs->name_nslots = nslots;
+    for (int i = 0; i < nslots; i++) ktfs->name_heads[i] = KTFS_NOFILE;
+
+    if (old_hash != NULL){
+        for (int i = 0; i < nfiles; i++) ktfs_name_insert(i, old_hash[i]);
+        free_phys_pages(old_hash, ktfs->name_npages);
+    }
+    ktfs->name_npages = npages;
+    return 0;
+}
+
+/**
+ * @brief reads the dentry in a slot of the root directory
+ * @param slot dentry slot
+ * @param dentry filled in with the dentry
+ * @return 0 on success, negative error code if the directory block couldn't be read
+ */
+static int ktfs_dentry_read(int slot, struct ktfs_dir_entry* dentry){
+    void * blkptr;
+    int retval;
+
+    int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, slot/KTFS_NUM_DENTRY_IN_BLOCK);
+    if (absolute_idx < 0) return absolute_idx;
+    retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr);
+    if (retval < 0) return retval;
+    memcpy(dentry, (struct ktfs_dir_entry *)blkptr + slot%KTFS_NUM_DENTRY_IN_BLOCK, KTFS_DENSZ);
+    cache_release_block(ktfs->cache_ptr, blkptr, 0);
+    return 0;
+}
+
+/**
+ * @brief finds the record of the file in a dentry slot
+ * @param slot dentry slot
+ * @return the record, NULL if the file has none
+ */
+static struct ktfs_file * ktfs_file_find(int slot){
+    struct ktfs_file * file = ktfs->file_heads[slot % KTFS_FILE_BUCKETS];
+    while (file != NULL && file->dentry_slot != slot) file = file->next;
+    return file;
+}
+
+/**
+ * @brief gets the record of the file in a dentry slot, making one if it has none. the inode isn't read in
+ * @param slot dentry slot
+ * @param dentry the dentry in it, for a new record
+ * @return the record, NULL if there's no memory for one
+ */
+static struct ktfs_file * ktfs_file_get(int slot, const struct ktfs_dir_entry* dentry){
+    struct ktfs_file * file = ktfs_file_find(slot);
+
+    if (file != NULL) return file;
+    if (ktfs->free_files != NULL){
+        file = ktfs->free_files;
+        ktfs->free_files = file->next;
+        memset(file, 0, sizeof(struct ktfs_file));
+    } else {
+        file = kcalloc(1, sizeof(struct ktfs_file));
+        if (file == NULL) return NULL;
+    }
+    memcpy(&file->dentry, dentry, KTFS_DENSZ);
+    file->dentry_slot = slot;
+    lock_init(&file->lock);
+    file->next = ktfs->file_heads[slot % KTFS_FILE_BUCKETS];
+    ktfs->file_heads[slot % KTFS_FILE_BUCKETS] = file;
+    return file;
+}
+
+/**
+ * @brief takes a record out of the record table
+ * @param file the record
+ */
+static void ktfs_file_unlink(struct ktfs_file* file){
+    struct ktfs_file ** link = &ktfs->file_heads[file->dentry_slot % KTFS_FILE_BUCKETS];
+    while (*link != file) link = &(*link)->next;
+    *link = file->next;
+}
+
+/**
+ * @brief gives up a file's record once nothing needs it: the file isn't open and its inode is in the inode table
+ * @param file the record
+ */
+static void ktfs_file_put(struct ktfs_file* file){
+    if (file->nopen > 0 || file->inode_dirty) return;
+    ktfs_file_unlink(file);
+    file->next = ktfs->free_files;
+    ktfs->free_files = file;
+}
+
+/**
+ * @brief moves a file's record to the dentry slot its dentry was moved to
+ * @param file the record
+ * @param slot new dentry slot
+ */
+static void ktfs_file_move(struct ktfs_file* file, int slot){
+    ktfs_file_unlink(file);
+    file->dentry_slot = slot;
+    file->next = ktfs->file_heads[slot % KTFS_FILE_BUCKETS];
+    ktfs->file_heads[slot % KTFS_FILE_BUCKETS] = file;
+}
+
+/**
+ * @brief finds a file in a hashed root directory, reading blocks from the name's own block on until one has the name
+ * or a never used dentry (see ktfs.h)
+ * @param name file name
+ * @param dentry filled in with the file's dentry if it's found (may be NULL)
+ * @return dentry slot of the file (directory block * KTFS_NUM_DENTRY_IN_BLOCK + index in it), -ENOENT if there's no
+ * such file, other negative error code if a directory block couldn't be read
+ */
+static int ktfs_hashdir_lookup(const char* name, struct ktfs_dir_entry* dentry){
+    unsigned int hash = ktfs_name_hash(name);
+    struct ktfs_dir_entry * dents;
+    int retval;
+
+    for (uint32_t n = 0; n < ktfs->dir_nbuckets; n++){
+        uint32_t b = (hash + n) & (ktfs->dir_nbuckets - 1);
+        int stop = 0;
+
+        int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, b);
+        if (absolute_idx < 0) return absolute_idx;
+        retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&dents);
+        if (retval < 0) return retval;
+        for (int i = 0; i < KTFS_NUM_DENTRY_IN_BLOCK; i++){
+            if (dents[i].name[0] == '\0'){
+                if (dents[i].inode == 0) stop = 1;
+                continue;
+            }
+            if (strncmp(name, dents[i].name, KTFS_MAX_FILENAME_LEN) == 0){
+                if (dentry != NULL) memcpy(dentry, &dents[i], KTFS_DENSZ);
+                cache_release_block(ktfs->cache_ptr, dents, 0);
+                return b*KTFS_NUM_DENTRY_IN_BLOCK + i;
+            }
+        }
+        cache_release_block(ktfs->cache_ptr, dents, 0);
+        if (stop) break;
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief creates a file in a hashed root directory: a fresh inode, and a dentry in the first free slot from the
+ * name's own block on. the directory never grows
+ * @param name file name
+ * @return 0 if successful, negative error code if error
+ */
+static int ktfs_hashdir_create(const char* name){
+    unsigned int hash = ktfs_name_hash(name);
+    struct ktfs_dir_entry * dents;
+    void * blkptr;
+    int retval;
+
+    retval = ktfs_hashdir_lookup(name, NULL);
+    if (retval >= 0) return -EEXIST;
+    if (retval != -ENOENT) return retval;
+
+    int new_inode = ktfs_find_and_use_free_inode_slot(ktfs->cache_ptr);
+    if (new_inode < 0) return new_inode;
+
+    //same as for a flat directory, the slot may have a deleted file's size and block pointers in it
+    retval = cache_get_block_flags(ktfs->cache_ptr, (new_inode/KTFS_NUM_INODES_IN_BLOCK + ktfs->inode_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr);
+    if (retval < 0){
+        ktfs_free_inode_slot(ktfs->cache_ptr, new_inode);
+        return retval;
+    }
+    memset((struct ktfs_inode *)blkptr + new_inode%KTFS_NUM_INODES_IN_BLOCK, 0, KTFS_INOSZ);
+    cache_release_block(ktfs->cache_ptr, blkptr, 1);
+
+    for (uint32_t n = 0; n < ktfs->dir_nbuckets; n++){
+        uint32_t b = (hash + n) & (ktfs->dir_nbuckets - 1);
+
+        int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, b);
+        if (absolute_idx < 0) retval = absolute_idx;
+        else retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_META, (void **)&dents);
+        if (retval < 0) break;
+        for (int i = 0; i < KTFS_NUM_DENTRY_IN_BLOCK; i++){
+            if (dents[i].name[0] != '\0') continue;
+            memset(&dents[i], 0, KTFS_DENSZ);
+            dents[i].inode = new_inode;
+            strncpy(dents[i].name, name, KTFS_MAX_FILENAME_LEN);
+            cache_release_block(ktfs->cache_ptr, dents, 1);
+            return 0;
+        }
+        cache_release_block(ktfs->cache_ptr, dents, 0);
+        retval = -ENOTSUP; //every dentry in the directory is taken
+    }
+
+    ktfs_free_inode_slot(ktfs->cache_ptr, new_inode);
+    return retval;
+}
+
+/**
+ * @brief deletes a file from a hashed root directory. its dentry is freed where it is; nothing moves
+ * @param name file name
+ * @return 0 if successful, negative error code if error
+ */
+static int ktfs_hashdir_delete(const char* name){
+    struct ktfs_dir_entry dentry;
+    struct ktfs_dir_entry * dents;
+    struct ktfs_inode inode;
+    void * blkptr;
+    int retval;
+
+    int slot = ktfs_hashdir_lookup(name, &dentry);
+    if (slot < 0) return slot;
+    struct ktfs_file * file = ktfs_file_find(slot); //only if it's open, or its inode never made it back
+    if (file != NULL && file->nopen > 0) return -EBUSY;
+
+    //the cached inode if the file has one (the table may not have caught up with it), the inode table otherwise
+    if (file != NULL && file->inode_loaded) inode = file->inode_data;
+    else {
+        retval = cache_get_block_flags(ktfs->cache_ptr, (dentry.inode/KTFS_NUM_INODES_IN_BLOCK + ktfs->inode_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr);
+        if (retval < 0) return retval;
+        memcpy(&inode, (struct ktfs_inode *)blkptr + dentry.inode%KTFS_NUM_INODES_IN_BLOCK, KTFS_INOSZ);
+        cache_release_block(ktfs->cache_ptr, blkptr, 0);
+    }
+
+    int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, slot/KTFS_NUM_DENTRY_IN_BLOCK);
+    if (absolute_idx < 0) return absolute_idx;
+    retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_META, (void **)&dents);
+    if (retval < 0) return retval;
+    //someone else may have deleted it while we waited
+    if (dents[slot%KTFS_NUM_DENTRY_IN_BLOCK].inode != dentry.inode || dents[slot%KTFS_NUM_DENTRY_IN_BLOCK].name[0] == '\0'){
+        cache_release_block(ktfs->cache_ptr, dents, 0);
+        return -ENOENT;
+    }
+
+    //lookups stop at a block with a never used dentry in it, so if there's one already the freed dentry can be never
+    //used too. in a full block it's marked deleted, so lookups go on past it
+    int stop = 0;
+    for (int i = 0; i < KTFS_NUM_DENTRY_IN_BLOCK; i++){
+        if (dents[i].name[0] == '\0' && dents[i].inode == 0) stop = 1;
+    }
+    memset(&dents[slot%KTFS_NUM_DENTRY_IN_BLOCK], 0, KTFS_DENSZ);
+    if (!stop) dents[slot%KTFS_NUM_DENTRY_IN_BLOCK].inode = KTFS_DENTRY_DELETED;
+    cache_release_block(ktfs->cache_ptr, dents, 1);
+
+    if (file != NULL){
+        file->inode_dirty = 0; //what it had is going away with the file
+        ktfs_file_put(file);
+    }
+    ktfs_free_inode_slot(ktfs->cache_ptr, dentry.inode);
+    ktfs_free_file_blocks(ktfs->cache_ptr, &inode);
+    return 0;
+}
+
+//the kernel is built without libgcc (and for a core without Zbb), so __builtin_ctzll/__builtin_popcountll would
+//leave us with undefined references. x must not be 0 for ctz
+static int ktfs_ctz64(uint64_t x){
+    static const uint8_t debruijn_idx[64] = {
+        0, 1, 2, 53, 3, 7, 54, 27, 4, 38, 41, 8, 34, 55, 48, 28,
+        62, 5, 39, 46, 44, 42, 22, 9, 24, 35, 59, 56, 49, 18, 29, 11,
+        63, 52, 6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+        51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12};
+    return debruijn_idx[((x & -x) * 0x022FDD63CC95386DULL) >> 58];
+}
+
+static int ktfs_popcount64(uint64_t x){
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
 /**
  * @brief Mounts the file system with associated backing cache
  * @param cache Pointer to cache struct for the file system
@@ -533,7 +1436,7 @@ int mount_ktfs(const char* name, struct cache* cache) {
     //"get superblock values" section //
     struct ktfs_superblock * superblock;
     
-    retval = cache_get_block(ktfs->cache_ptr, 0, (void **) &superblock);
+    retval = cache_get_block_flags(ktfs->cache_ptr, 0, CACHE_SHARED | CACHE_META, (void **) &superblock);
     if (retval < 0){ 
         trace("cache_get_block failed\n");
         return retval;
@@ -556,13 +1459,32 @@ int mount_ktfs(const char* name, struct cache* cache) {
 
     ktfs->root_directory_inode = superblock->root_directory_inode;
     ktfs->block_cnt = superblock->block_count; //new addition!!!!
+    ktfs->hashdir = (superblock->features & KTFS_FEATURE_HASHDIR) != 0;
+    ktfs->dir_nbuckets = superblock->dir_bucket_count;
 
-    //allocates an array for the blank definition in records, as big as the max number of inodes (calculated by the number of bytes in the inode blocks, divided by the size of an inode) 
+    //the max number of inodes (calculated by the number of bytes in the inode blocks, divided by the size of an inode) 
     ktfs->max_inode_count = (superblock->inode_block_count * KTFS_BLKSZ)/KTFS_INOSZ; 
     trace("max_inode_count at mount_ktfs: %d\n", ktfs->max_inode_count);
-    records = kcalloc(1, sizeof(struct ktfs_file_records)+ktfs->max_inode_count* sizeof(uint64_t));
     cache_release_block(ktfs->cache_ptr, (void*)superblock, 0); 
     //end of "get superblock values" section // 
+
+#if KTFS_MOUNT_WARMUP
+    //warm-up: the bitmaps and the inode table sit right after the superblock, so read them in with a few
+    //big requests now rather than a miss at a time later. a failure here only costs us the warm-up
+    retval = cache_prefetch(ktfs->cache_ptr, ktfs->inode_bitmap_block_start*KTFS_BLKSZ,
+        ktfs->data_block_start - ktfs->inode_bitmap_block_start, CACHE_META);
+    if (retval < 0) trace("metadata warm-up failed: %s\n", error_name(retval));
+#endif
+
+    //allocator state, with a free count per bitmap block (the warm-up just read them in). inode numbers are 16 bits
+    //in a dentry, and there can't be more of them than the inode table holds or the inode bitmap covers
+    retval = ktfs_bitmap_init(ktfs->cache_ptr, &ktfs->db_map, ktfs->bitmap_block_start, ktfs->block_cnt - ktfs->data_block_start);
+    if (retval == 0) retval = ktfs_bitmap_init(ktfs->cache_ptr, &ktfs->ino_map, ktfs->inode_bitmap_block_start,
+        MIN(MIN(ktfs->max_inode_count, (ktfs->bitmap_block_start - ktfs->inode_bitmap_block_start)*KTFS_BITS_PER_BLK), UINT16_MAX + 1));
+    if (retval < 0){
+        trace("cache_get_block failed\n");
+        return retval;
+    }
     
  
     //"initialize and attach filesystem" section //
@@ -587,7 +1509,7 @@ int mount_ktfs(const char* name, struct cache* cache) {
     int root_dir_inode_inblock_offset = ktfs->root_directory_inode % KTFS_NUM_INODES_IN_BLOCK;
 
     struct ktfs_data_block * block=NULL; 
-    retval = cache_get_block( ktfs->cache_ptr , (ktfs->inode_block_start + root_dir_inode_relative_offset)*KTFS_BLKSZ, (void **) &block);  
+    retval = cache_get_block_flags( ktfs->cache_ptr , (ktfs->inode_block_start + root_dir_inode_relative_offset)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **) &block);  
     if (retval <0){ 
         trace("cache_get_block failed\n");
         return retval;
@@ -597,39 +1519,47 @@ int mount_ktfs(const char* name, struct cache* cache) {
     //ktfs->num_files = ktfs->root_directory_inode_data.size / KTFS_DENSZ; 
     int num_files = ktfs->root_directory_inode_data.size/KTFS_DENSZ;
 
+    //a hashed directory is looked up where it is, so there's nothing to scan
+    if (ktfs->hashdir){
+        if (ktfs->dir_nbuckets == 0 || (ktfs->dir_nbuckets & (ktfs->dir_nbuckets - 1)) != 0
+            || ktfs->root_directory_inode_data.size != ktfs->dir_nbuckets*KTFS_BLKSZ){
+            trace("hashed root directory doesn't match the superblock\n");
+            return -EBADFMT;
+        }
+        trace("successful ktfs mount (hashed root directory)\n");
+        return 0;
+    }
+
+    //name index, a bucket per dentry slot and room for the files there are now. only the hash of each name is kept;
+    //file records are made by open
+    int nslots = KTFS_NAME_MIN_SLOTS;
+    while (nslots < num_files) nslots *= 2;
+    retval = ktfs_name_index_resize(nslots, 0);
+    if (retval < 0) return retval;
+
     /*
      SCANNING ALL DENTRIES AT THE BEGINNING
-    motivation: scanning all of the dentries in the file system so that we have a full record book of all the files we start out with and their names. Decreases runtime tremendously compared to scanning through all the dentries on every file_open
-    implementation: we traverse all of the dentries in the root_directory_inodes datablocks with the help of our absolute_idx function. we keep a whole datablock allocated onto the struct and memcpy the entire datablock onto it whenever we're done reading the last one
+    motivation: hashing every name now means open doesn't have to scan the dentries for one
+    implementation: we traverse all of the dentries in the root_directory_inodes datablocks with the help of our absolute_idx function, a block held at a time
     */
-    void * tempptr;
-    struct ktfs_dir_entry dentry_block[KTFS_NUM_DENTRY_IN_BLOCK];
+    struct ktfs_dir_entry * dentry_block = NULL;
     for (int i = 0; i < num_files; i++){
         if ((i % KTFS_NUM_DENTRY_IN_BLOCK) == 0){ 
             int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, i/KTFS_NUM_DENTRY_IN_BLOCK); 
             if (absolute_idx < 0) return absolute_idx;//propagate errors. more importantly this is the only function in mount that won't print an error for trace, so if it fails you know why
-            cache_get_block(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, &tempptr);
+            retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&dentry_block);
             if (retval <0){ 
                 trace("cache_get_block failed\n");
-                cache_release_block(ktfs->cache_ptr, (void *)superblock, 0);
                 return retval;
             } 
             //trace("got block for dentry scan\n");
-            memcpy((void *)&dentry_block, tempptr, sizeof(dentry_block));
-            cache_release_block(ktfs->cache_ptr, tempptr, 0);
-
         }
 
+        ktfs_name_insert(i, ktfs_name_hash(dentry_block[i%KTFS_NUM_DENTRY_IN_BLOCK].name));
+        trace("name:%s, inode: %d\n", dentry_block[i%KTFS_NUM_DENTRY_IN_BLOCK].name, dentry_block[i%KTFS_NUM_DENTRY_IN_BLOCK].inode);
 
-        records->filetab[i] = kcalloc(1, sizeof(struct ktfs_file));
-
-        memcpy(&records->filetab[i]->dentry,&dentry_block[i%KTFS_NUM_DENTRY_IN_BLOCK], KTFS_DENSZ); //immediately copy in the dentry data into the file record
-		records->filetab[i]->dentry_slot = i;//cp2 addition
- 
-        struct uio_intf * file_uio_intf = kcalloc(1, sizeof(struct uio_intf)); //immediately add a uio interface for all the files we scan through
-        memcpy(file_uio_intf, &initial_file_uio_intf, sizeof(struct uio_intf));
-        uio_init0(&records->filetab[i]->base, file_uio_intf);
-        trace("name:%s, inode: %d\n", records->filetab[i]->dentry.name,records->filetab[i]->dentry.inode);
+        if ((i % KTFS_NUM_DENTRY_IN_BLOCK) == KTFS_NUM_DENTRY_IN_BLOCK - 1 || i == num_files - 1)
+            cache_release_block(ktfs->cache_ptr, dentry_block, 0);
     }
 
     trace("successful ktfs mount\n");
@@ -661,74 +1591,69 @@ int ktfs_open(struct filesystem* fs, const char* name, struct uio** uioptr) { //
         struct ktfs_listing_uio * ls;
         ls = kcalloc(1, sizeof(*ls));
         ls->read_idx = 0;
-        ls->records = records;
         *uioptr  = uio_init1(&ls->base, &ktfs_listing_uio_intf);
         return 0;
     }
 
     //"search for inode that matches name" section //
-    int i = 0;
-    while (i < ktfs->max_inode_count){
-        if (records->filetab[i]) trace("name: %s, records->filetab[i]->dentry.name: %s\n",name, records->filetab[i]->dentry.name);
-        if (records->filetab[i] && !strncmp(name, records->filetab[i]->dentry.name, KTFS_MAX_FILENAME_LEN)){
-            
-            break;
-        }
-
-        i++;
-    }
+    struct ktfs_dir_entry dentry;
+    int slot = ktfs_name_lookup(name, &dentry);
     
     //guardcase for no matching file found 
-    trace("i: %d\n",i);
-    trace("max_inode_count = %d\n", ktfs->max_inode_count);
-    if (i == ktfs->max_inode_count){
+    trace("slot: %d\n", slot);
+    if (slot < 0){
 		trace("no matching file found\n");
-		return -ENOENT; 
+		return slot; 
 	}
 
-    //guardcase for already opened 
-    if (records->filetab[i]->opened ==1) return -EBUSY;
-
-    //this wasn't nessesary because I already have an opened flag which is 1 whenever there is atleast one uioptr referencing it
-    //guardcase for if the file is already referenced by another uioptr
-    //if (uio_refcnt(&records->filetab[i]->base) >0) return -EBUSY; //it decrements to 0 anyway on close
-    //else uio_addref() happens towards the end
+    //every open gets its own uio and position. the record and its inode are shared, so only an open of a file that
+    //isn't open yet makes the record and reads the inode in; the others see it as the opens before them (and their
+    //writes) left it. the count goes up first so a delete can't take the file away while we wait for the inode
+    struct ktfs_file * file = ktfs_file_get(slot, &dentry);
+    if (file == NULL) return -ENOMEM;
+
+    struct ktfs_file_uio * fu = ktfs->free_uios;
+    if (fu != NULL){
+        uint32_t * blkmap = fu->blkmap; //the buffer goes with the uio, its contents don't
+        ktfs->free_uios = fu->next_free;
+        memset(fu, 0, sizeof(struct ktfs_file_uio));
+        fu->blkmap = blkmap;
+    } else fu = kcalloc(1, sizeof(struct ktfs_file_uio));
+    if (fu == NULL){
+        ktfs_file_put(file);
+        return -ENOMEM;
+    }
+    fu->file = file;
+    file->nopen++;
 
-	//could maybe have a dentry slot assertion here
+    if (file->inode_loaded){
+        *uioptr = uio_init1(&fu->base, &initial_file_uio_intf);
+        return 0;
+    }
 
-    //if i != records->max_inodes, then we have an i in bounds, which means a matching file name was found
-    int inode_idx = records->filetab[i]->dentry.inode;
+    int inode_idx = file->dentry.inode;
     int absolute_block_of_inode = inode_idx/KTFS_NUM_INODES_IN_BLOCK + ktfs->inode_block_start;
     int inter_block_inode_idx = inode_idx%KTFS_NUM_INODES_IN_BLOCK;
     
-    //trace("size before memcpy in %s : %d\n", __func__, records->filetab[i]->inode_data.size);
-    
-    retval = cache_get_block(ktfs->cache_ptr, KTFS_BLKSZ*absolute_block_of_inode, &blkptr);
-    if (retval < 0) {
-        cache_release_block(ktfs->cache_ptr, blkptr, 0);
+    retval = cache_get_block_flags(ktfs->cache_ptr, KTFS_BLKSZ*absolute_block_of_inode, CACHE_SHARED | CACHE_META, &blkptr);
+    if (retval < 0){
+        file->nopen--;
+        ktfs_file_put(file);
+        fu->next_free = ktfs->free_uios;
+        ktfs->free_uios = fu;
         return retval;
     }
 
-    struct ktfs_inode inode_src = ((struct ktfs_inode*)blkptr)[inter_block_inode_idx];
-    memcpy(&records->filetab[i]->inode_data, &inode_src, sizeof(struct ktfs_inode));
-    //records->filetab[i]->inode_data = inode_dest; //the inode_data pointer member now points to the corresponding inode
-    trace("file starts at absolute position:%d\n", records->filetab[i]->inode_data.block[0]+ktfs->data_block_start);
-    
-    records->filetab[i]->opened = 1; // mark the file as open
+    //another open of the file may have read the inode in (and written through it) while we waited for the block
+    if (!file->inode_loaded){
+        memcpy(&file->inode_data, (struct ktfs_inode*)blkptr + inter_block_inode_idx, sizeof(struct ktfs_inode));
+        file->inode_loaded = 1;
+    }
+    trace("file starts at absolute position:%d\n", file->inode_data.block[0]+ktfs->data_block_start);
 
     cache_release_block(ktfs->cache_ptr, blkptr, 0);
-    //trace("size at end of %s : %d\n", __func__, records->filetab[i]->inode_data.size);
-    
-    //unsigned long pos = 0;
-    //retval = uio_cntl(&records->filetab[i]->base, FCNTL_SETPOS, &pos); //set the position to 0 incase it was opened (and closed) before
-    //if (retval< 0) return retval;
-
-    records->filetab[i]->pos = 0;
 
-    //trace("ktfs_filetab[%d]->inode. = %d\n", i, ktfs_filetab[i]->inode_data);
-
-    *uioptr = &records->filetab[i]->base;
-    uio_addref(*uioptr);
+    *uioptr = uio_init1(&fu->base, &initial_file_uio_intf);
     return 0;
 
 }
@@ -740,9 +1665,12 @@ int ktfs_open(struct filesystem* fs, const char* name, struct uio** uioptr) { //
  */
 void ktfs_close(struct uio* uio) {
     trace("%s(uio=%p)", __func__, uio);
-    struct ktfs_file * file = (void *)uio - offsetof(struct ktfs_file , base );
-    file->pos = 0;
-    file->opened = 0;
+    struct ktfs_file_uio * fu = (void *)uio - offsetof(struct ktfs_file_uio , base );
+    fu->file->nopen--;
+    ktfs_inode_writeback(fu->file); //nothing to report an error to. the inode stays dirty and the next close or flush tries again
+    ktfs_file_put(fu->file);
+    fu->next_free = ktfs->free_uios;
+    ktfs->free_uios = fu;
     //trace("%s: size: %d\n",__func__,file->inode_data.size);
     //we don't need to decrement the count here because uio_close (its wrapper function) already does that for us)
     //cache_flush??? //<- no. at this point the blocks are marked as clean or dirty in the cache. them being open or closed doesn't change anything about the cache behavior
@@ -762,44 +1690,80 @@ long ktfs_fetch(struct uio* uio, void* buf, unsigned long len) {
     
     if (len == 0) return 0; //both the pointers were validated but the caller has for some reason requested to read 0 bytes
     
-    struct ktfs_file * file = (void *)uio - offsetof(struct ktfs_file , base);
+    struct ktfs_file_uio * fu = (void *)uio - offsetof(struct ktfs_file_uio , base);
+    struct ktfs_file * file = fu->file;
     int retval;
 
     //trace("reached here\n");//NOTE: FILE SIZE DOESN"T ACTUALLY ENCODE THE FILESIZE
     //uint32_t size = file->inode_data.size;
     //trace("%s: size: %d\n", __func__, size);
-    
-    if (!file->opened) return -EINVAL;
 
-    if (file->pos >=file->inode_data.size) return 0; //return if we're already at the end of the file
+    if (fu->pos >=file->inode_data.size) return 0; //return if we're already at the end of the file
 
     // Adjust len to read only up to the end of the file
-    if (file->pos + len > file->inode_data.size) len = file->inode_data.size - file->pos; 
+    if (fu->pos + len > file->inode_data.size) len = file->inode_data.size - fu->pos; 
 
 
     unsigned long nfetched = 0;
     unsigned long nread;
-    uint32_t absolute_idx;
-    struct ktfs_data_block *cache_block;
+    int absolute_idx;
+    struct ktfs_data_block *run_blks[CACHE_IO_MAX];
+    int direct = fu->direct || len >= KTFS_DIRECT_MIN; //big reads skip the cache, see cache_fetch_direct
 
     while (nfetched < len){
-        
-        nread = MIN(KTFS_BLKSZ - file->pos%KTFS_BLKSZ, len - nfetched); //chooses between the didtance btween the pos and the next block, or whatevers left to fetch
-        
-        absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &file->inode_data, file->pos/KTFS_BLKSZ);
+        int first_blk = fu->pos/KTFS_BLKSZ;
+        int nblks = MIN((fu->pos%KTFS_BLKSZ + len - nfetched + KTFS_BLKSZ - 1)/KTFS_BLKSZ, CACHE_IO_MAX);
+        int nrun;
+
+        absolute_idx = ktfs_file_block_idx(fu, first_blk);
         if (absolute_idx < 0) return absolute_idx; //propagate error
 
-        retval = cache_get_block(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, (void *) &cache_block);
+        //a hole reads as zeros (see KTFS_HOLE)
+        if (absolute_idx == 0){
+            nread = MIN(KTFS_BLKSZ - fu->pos%KTFS_BLKSZ, len - nfetched);
+            memset((char *)buf+nfetched, 0, nread);
+            nfetched += nread;
+            fu->pos += nread;
+            continue;
+        }
+
+        //in direct mode the whole blocks from pos on that sit next to each other on disk go from the device
+        //straight into buf. a partial block at either end still goes through the cache below
+        if (direct && fu->pos%KTFS_BLKSZ == 0 && len - nfetched >= KTFS_BLKSZ){
+            int nwhole = (len - nfetched)/KTFS_BLKSZ;
+            long ndirect;
+
+            for (nrun = 1; nrun < nwhole; nrun++){
+                if (ktfs_file_block_idx(fu, first_blk + nrun) != absolute_idx + nrun) break;
+            }
+            ndirect = cache_fetch_direct(ktfs->cache_ptr, (unsigned long long)absolute_idx*KTFS_BLKSZ, (char *)buf+nfetched, (unsigned long)nrun*KTFS_BLKSZ);
+            if (ndirect < 0) return ndirect;
+            if (ndirect < (long)nrun*KTFS_BLKSZ) return -EIO; //the file's blocks are all on the device
+            nfetched += ndirect;
+            fu->pos += ndirect;
+            continue;
+        }
+
+        //the blocks from pos on that sit next to each other on disk are pinned together, so the ones that
+        //miss come in with one request. a direct read only gets here for the partial block at either end
+        if (direct) nblks = 1;
+        for (nrun = 1; nrun < nblks; nrun++){
+            if (ktfs_file_block_idx(fu, first_blk + nrun) != absolute_idx + nrun) break;
+        }
+
+        retval = cache_get_blocks(ktfs->cache_ptr, (unsigned long long)absolute_idx*KTFS_BLKSZ, nrun, CACHE_SHARED, (void **)run_blks);
         if (retval < 0){
-            trace("cache_get_block failed: retval: %d\n", retval);
-            //cache_release_block(ktfs->cache_ptr, (void*)cache_block, 0);
+            trace("cache_get_blocks failed: retval: %d\n", retval);
             return retval;
         }
-        memcpy((char *)buf+nfetched, (char *)(cache_block->data)+(file->pos % KTFS_BLKSZ),nread);
-        cache_release_block(ktfs->cache_ptr, (void*)cache_block, 0);
 
-        nfetched += nread;
-        file->pos += nread;
+        for (int i = 0; i < nrun; i++){
+            nread = MIN(KTFS_BLKSZ - fu->pos%KTFS_BLKSZ, len - nfetched); //chooses between the didtance btween the pos and the next block, or whatevers left to fetch
+            memcpy((char *)buf+nfetched, (char *)(run_blks[i]->data)+(fu->pos % KTFS_BLKSZ),nread);
+            nfetched += nread;
+            fu->pos += nread;
+        }
+        cache_release_blocks(ktfs->cache_ptr, (void **)run_blks, nrun, 0);
     }
     return nfetched; 
 }
@@ -820,43 +1784,89 @@ long ktfs_store(struct uio* uio, const void* buf, unsigned long len) {
     
     if (len == 0) return 0; //both the pointers were validated but the caller has for some reason requested to read 0 bytes
     
-    struct ktfs_file * file = (void *)uio - offsetof(struct ktfs_file , base);
+    struct ktfs_file_uio * fu = (void *)uio - offsetof(struct ktfs_file_uio , base);
+    long retval;
+
+    //the size this store goes by, and every block it fills or appends, stay its own until it's done
+    lock_acquire(&fu->file->lock);
+    retval = ktfs_file_store(fu, buf, len);
+    lock_release(&fu->file->lock);
+    return retval;
+}
+
+/**
+ * @brief the body of ktfs_store(): overwrites the part of [pos, pos + len) inside the file and appends the rest. caller
+ * must hold the file's lock
+ * @param fu the open file
+ * @param buf The buffer to be read from
+ * @param len Number of bytes to write, at least 1
+ * @return Number of bytes written, negative error code if error
+ */
+static long ktfs_file_store(struct ktfs_file_uio* fu, const void* buf, unsigned long len){
+    struct ktfs_file * file = fu->file;
     int retval;
     int firstlen = len;
     int secondlen = 0;
     
     
-    trace("file->pos: %d\n", file->pos);
-    if (file->pos + len > file->inode_data.size){
-        firstlen = file->inode_data.size - file->pos;
+    trace("fu->pos: %d\n", fu->pos);
+    if (fu->pos + len > file->inode_data.size){
+        firstlen = file->inode_data.size - fu->pos;
         secondlen = len - firstlen;
     } 
     trace("firstlen: %d\n", firstlen);
     trace("secondlen: %d\n", secondlen);
     
 
-    if (!file->opened) return -EINVAL;
-
     unsigned long nstored = 0;
     unsigned long nwritten;
-    uint32_t absolute_idx;
+    int absolute_idx;
     struct ktfs_data_block *cache_block;
     int printflag = 0;
-	trace("file->pos: %d\n", file->pos);
+    int fresh;
+    int direct = fu->direct || len >= KTFS_DIRECT_MIN; //big writes skip the cache, see cache_store_direct
+	trace("fu->pos: %d\n", fu->pos);
 	//trace("string: %s",buf);
     //case one: overwriting the file
     while (nstored < firstlen){
         //if (firstlen == 0) trace("null entry\n");
-        nwritten = MIN(KTFS_BLKSZ - file->pos%KTFS_BLKSZ, firstlen - nstored); //chooses between the didtance btween the pos and the next block, or whatevers left to fetch
+        nwritten = MIN(KTFS_BLKSZ - fu->pos%KTFS_BLKSZ, firstlen - nstored); //chooses between the didtance btween the pos and the next block, or whatevers left to fetch
         
         if (printflag == 0){ 
             kprintf("overwrite case reached\n");
             printflag++;
         }
-        absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &file->inode_data, file->pos/KTFS_BLKSZ);
-        if (absolute_idx < 0) {
-            kprintf("absolute_idx <0");
-            return absolute_idx; //propagate error
+        absolute_idx = ktfs_file_block_idx(fu, fu->pos/KTFS_BLKSZ);
+        if (absolute_idx < 0) return absolute_idx; //propagate error, before it's taken for a hole or a block number
+
+        //a store into a hole gives it a block (see ktfs_file_setend). the rest of the block has to read as zeros
+        fresh = (absolute_idx == 0);
+        if (fresh){
+            retval = ktfs_file_fill_hole(fu, fu->pos/KTFS_BLKSZ, KTFS_NOGOAL);
+            if (retval < 0) return retval;
+            absolute_idx = retval;
+        }
+
+        //as in fetch, a direct write sends the whole blocks from pos on that sit next to each other on disk from buf
+        //straight to the device, and only a partial block at either end goes through the cache
+        if (direct && fu->pos%KTFS_BLKSZ == 0 && firstlen - nstored >= KTFS_BLKSZ){
+            int first_blk = fu->pos/KTFS_BLKSZ;
+            int nwhole = (firstlen - nstored)/KTFS_BLKSZ;
+            int nrun;
+            long ndirect;
+
+            //holes in the run get the blocks that follow on from it, so they go out with it
+            for (nrun = 1; nrun < nwhole; nrun++){
+                int next_idx = ktfs_file_block_idx(fu, first_blk + nrun);
+                if (next_idx == 0) next_idx = ktfs_file_fill_hole(fu, first_blk + nrun, absolute_idx + nrun - ktfs->data_block_start);
+                if (next_idx != absolute_idx + nrun) break;
+            }
+            ndirect = cache_store_direct(ktfs->cache_ptr, (unsigned long long)absolute_idx*KTFS_BLKSZ, (char *)buf+nstored, (unsigned long)nrun*KTFS_BLKSZ);
+            if (ndirect < 0) return ndirect;
+            if (ndirect < (long)nrun*KTFS_BLKSZ) return -EIO; //the file's blocks are all on the device
+            nstored += ndirect;
+            fu->pos += ndirect;
+            continue;
         }
 
         //trace("a number that is pretty important to us at this point: %d", absolute_idx*KTFS_BLKSZ);
@@ -867,18 +1877,19 @@ long ktfs_store(struct uio* uio, const void* buf, unsigned long len) {
             return retval;
         }
         trace("ok so at this point we should have cache_get_blocked something lets see what happened about it");
-        //memcpy((char *)buf+nstored, (char *)(cache_block->data)+(file->pos % KTFS_BLKSZ),nwritten); //TODO... THIS WHOLE THING WAS PASTED FROM FETCH
-        memcpy((char *)(cache_block->data)+(file->pos % KTFS_BLKSZ), (char *)buf+nstored,nwritten); //TODO... THIS WHOLE THING WAS PASTED FROM FETCH
+        //memcpy((char *)buf+nstored, (char *)(cache_block->data)+(fu->pos % KTFS_BLKSZ),nwritten); //TODO... THIS WHOLE THING WAS PASTED FROM FETCH
+        if (fresh && nwritten < KTFS_BLKSZ) memset(cache_block->data, 0, KTFS_BLKSZ);
+        memcpy((char *)(cache_block->data)+(fu->pos % KTFS_BLKSZ), (char *)buf+nstored,nwritten); //TODO... THIS WHOLE THING WAS PASTED FROM FETCH
         cache_release_block(ktfs->cache_ptr, cache_block, 1);
 
         nstored += nwritten;
-        file->pos += nwritten;
+        fu->pos += nwritten;
     }
 
     //second case: append to end
     if (secondlen != 0) kprintf("append case reached\n");
 
-    nstored += ktfs_appender(ktfs->cache_ptr, &file->inode_data, (char*)buf+nstored, secondlen, F_APPEND_STORE); //keep in mind that this will return 0 if second len is 0
+    nstored += ktfs_appender(ktfs->cache_ptr, &file->inode_data, fu, (char*)buf+nstored, secondlen, F_APPEND_STORE); //keep in mind that this will return 0 if second len is 0
 	trace("file data after store:\n");
 	trace("file size: %d\n", file->inode_data.size);
 
@@ -906,6 +1917,7 @@ int ktfs_create(struct filesystem* fs, const char* name) {
 		trace("file name is too big");
 		return -ENOTSUP;
 	}
+    if (ktfs_inst->hashdir) return ktfs_hashdir_create(name);
     //trace("ktfs->max_inode_count in ktfs create: %d\n", ktfs->max_inode_count);
     //trace("ktfs_inst->root_directory_inode_data.size: %d and ktfs_inst->max_inode_count: %d\n", ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ, ktfs_inst->max_inode_count);
     if (ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ >= ktfs_inst->max_inode_count){
@@ -914,21 +1926,26 @@ int ktfs_create(struct filesystem* fs, const char* name) {
     }
     trace("ktfs_create got: got through first 3 guard cases\n");
 
-    int i = 0; //search for file with matching name
-    while (i< ktfs_inst->max_inode_count){
-        if (records->filetab[i] && !strncmp(name, records->filetab[i]->dentry.name, KTFS_MAX_FILENAME_LEN)) return -EEXIST;
-        i++;
+    int retval = ktfs_name_lookup(name, NULL); //search for file with matching name
+    if (retval >= 0) return -EEXIST;
+    if (retval != -ENOENT) return retval;
+
+    //room in the name index for one more file, before anything on disk changes
+    if (ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ >= ktfs_inst->name_nslots){
+        retval = ktfs_name_index_resize(2*ktfs_inst->name_nslots, ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ);
+        if (retval < 0) return retval;
     }
     
     //first see if we can even get another inode slot
     struct ktfs_dir_entry dentry; //if we have size for one, this will be what we memset onto the filesystem book
-    dentry.inode = ktfs_find_and_use_free_inode_slot(ktfs_inst->cache_ptr);
+    int new_inode = ktfs_find_and_use_free_inode_slot(ktfs_inst->cache_ptr); //not straight into dentry.inode, which is unsigned
 
-	trace("inoed of choice: dentry.inode= %d\n", dentry.inode);
-    if (dentry.inode< 0) {
+	trace("inoed of choice: %d\n", new_inode);
+    if (new_inode < 0) {
         trace("our find free inode funciton might be the one having issues\n");
-        return dentry.inode; 
+        return new_inode; 
     }
+    dentry.inode = new_inode;
 
     strncpy(dentry.name, name, KTFS_MAX_FILENAME_LEN);
     
@@ -936,7 +1953,7 @@ int ktfs_create(struct filesystem* fs, const char* name) {
     //get and preupdate root directory inode 
     struct ktfs_inode * rdr_copy = &ktfs_inst->root_directory_inode_data;
 	trace("calculated rdr block to be at: %d\n", ((ktfs_inst->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK)+ ktfs_inst->inode_block_start));
-    cache_get_block(ktfs_inst->cache_ptr, ((ktfs_inst->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK)+ ktfs_inst->inode_block_start)*KTFS_BLKSZ, &blkptr);
+    cache_get_block_flags(ktfs_inst->cache_ptr, ((ktfs_inst->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK)+ ktfs_inst->inode_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr);
     struct ktfs_inode * rdr = (struct ktfs_inode*)blkptr + (ktfs_inst->root_directory_inode%KTFS_NUM_INODES_IN_BLOCK);
     memcpy(rdr_copy, rdr, KTFS_INOSZ);
     if (rdr->size + KTFS_DENSZ > KTFS_MAX_FILE_SIZE){
@@ -951,11 +1968,11 @@ int ktfs_create(struct filesystem* fs, const char* name) {
 
 	trace("reached\n");
     //append file onto root directory inode
-    ktfs_appender(ktfs_inst->cache_ptr, rdr_copy, (void *)&dentry, KTFS_DENSZ, F_APPEND_CREATE);
+    ktfs_appender(ktfs_inst->cache_ptr, rdr_copy, NULL, (void *)&dentry, KTFS_DENSZ, F_APPEND_CREATE);
 	trace("size of rdr on new file, and before redundant memcpy: %d\n",ktfs_inst->root_directory_inode_data.size);
-    cache_get_block(ktfs_inst->cache_ptr, 
+    cache_get_block_flags(ktfs_inst->cache_ptr, 
 					((ktfs->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK)+ ktfs->inode_block_start)*KTFS_BLKSZ, 
-					&blkptr);
+					CACHE_META, &blkptr);
     rdr = (struct ktfs_inode*)blkptr + (ktfs->root_directory_inode%KTFS_NUM_INODES_IN_BLOCK); //I think the appender might already work on this logic... never mind what about new datablocks? 
 																								//could look into adding this logic for CREATE case in the appender.
     trace("rdr_copy->size: %d and rdr->size: %d\n", rdr_copy->size, rdr->size);
@@ -965,32 +1982,22 @@ int ktfs_create(struct filesystem* fs, const char* name) {
 	
 
     
-    //memset inode TODO: DO WE NEED TO KEEP THIS? answer, probably not considering the fact that the parts we don't use are ignored due to file size bookkeeping
-    //cache_get_block(ktfs_inst->cache_ptr, (dentry.inode/KTFS_NUM_INODES_IN_BLOCK+ktfs_inst->inode_block_start)*KTFS_BLKSZ, &blkptr);//error here, should've been inode blockstart
-    //memset((struct ktfs_inode *)blkptr+ dentry.inode%KTFS_NUM_INODES_IN_BLOCK, 0, KTFS_INOSZ);
-    //cache_release_block(ktfs_inst->cache_ptr, blkptr, 1);
-
-    //add new ktfs_file to filetab
-    struct ktfs_file * new_file = kcalloc(1, sizeof(struct ktfs_file));
-    for (int i = 0; i < ktfs_inst->max_inode_count; i++){ //already checked that we're not exceeding the max number of files that our filesystem image can support
-        if (records->filetab[i] == NULL) {
-            records->filetab[i] = new_file; 
-            trace("put on index i: %d\n", i);
-            memcpy(&records->filetab[i]->dentry, &dentry, KTFS_DENSZ);//only thing we really need to replace otherwise remember memset makes everyhting 0. which is what we want
-            trace("dentry_slot: %d\n",records->filetab[i]->dentry_slot);
-			records->filetab[i]->dentry_slot = new_dentry_slot; //new addition
-			kprintf("kid named inode: %s at record index %d\n",records->filetab[i]->dentry.name, i);
-            struct uio_intf * file_uio_intf = kcalloc(1, sizeof(struct uio_intf)); //nope never mind we want this too... (copied from mount_ktfs)
-            memcpy(file_uio_intf, &initial_file_uio_intf, sizeof(struct uio_intf));
-            uio_init0(&records->filetab[i]->base, file_uio_intf);
-            return 0;
-        }
-    }
-
-    trace("since we've already checked whether or not we have the facilities to support a new file, it would be really weird if we reached this point\n");
-    return -EINVAL; 
-
+    //memset inode. we do need it: delete leaves the old size and block pointers in the slot, and a file that picked
+    //them up would append after blocks the allocator has already handed to someone else
+    cache_get_block_flags(ktfs_inst->cache_ptr, (dentry.inode/KTFS_NUM_INODES_IN_BLOCK+ktfs_inst->inode_block_start)*KTFS_BLKSZ, CACHE_META, &blkptr);
+    memset((struct ktfs_inode *)blkptr+ dentry.inode%KTFS_NUM_INODES_IN_BLOCK, 0, KTFS_INOSZ);
+    cache_release_block(ktfs_inst->cache_ptr, blkptr, 1);
 
+    //no record: the first open makes one, and reads the inode we just zeroed. another create may have taken the
+    //room made above while we waited on the cache. if there's none to be had now the file is on disk, but it can't
+    //be opened until the next mount
+    if (new_dentry_slot >= ktfs_inst->name_nslots){
+        retval = ktfs_name_index_resize(2*ktfs_inst->name_nslots, new_dentry_slot);
+        if (retval < 0) return retval;
+    }
+    ktfs_name_insert(new_dentry_slot, ktfs_name_hash(dentry.name));
+    trace("dentry_slot: %d\n", new_dentry_slot);
+    return 0;
 }
 
 /**
@@ -1011,15 +2018,31 @@ int ktfs_delete(struct filesystem* fs, const char* name) {
 
 
     if (strlen(name) > KTFS_MAX_FILENAME_LEN) return -ENOTSUP; //10/22 I'm sure that this is not our delete bug
+    if (ktfs_inst->hashdir) return ktfs_hashdir_delete(name);
     if (ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ < 1){
 		trace("too many inodes im ktfsed");
 		 return -EINVAL;
 	}
+
+    //find the file before touching the root directory, so a missing or open file leaves it alone
+    struct ktfs_dir_entry target_dentry;
+    int target_dentry_slot = ktfs_name_lookup(name, &target_dentry);
+    trace("some delete shenanigans: target_dentry_slot: %d\n", target_dentry_slot);
+
+    if (target_dentry_slot < 0){
+		trace("no file with that name exists\n");
+		return target_dentry_slot; //file not found
+	}
+    struct ktfs_file * target_file = ktfs_file_find(target_dentry_slot); //only if it's open, or its inode never made it back
+    if (target_file != NULL && target_file->nopen > 0) {	
+		trace("doing delete on an open file smh\n");
+		return -EBUSY;
+	}
 	
 
     //race cond starts pretty much here tbh 
     int rdr_blk = ((ktfs_inst->root_directory_inode/KTFS_NUM_INODES_IN_BLOCK)+ ktfs_inst->inode_block_start);
-    cache_get_block(ktfs_inst->cache_ptr, rdr_blk * KTFS_BLKSZ, &blkptr); 
+    cache_get_block_flags(ktfs_inst->cache_ptr, rdr_blk * KTFS_BLKSZ, CACHE_META, &blkptr); 
     struct ktfs_inode * rdr = (struct ktfs_inode*)blkptr + (ktfs_inst->root_directory_inode%KTFS_NUM_INODES_IN_BLOCK);
     if (rdr->size < KTFS_DENSZ){
         trace("rdr size is less than dentry size, cooked\n");
@@ -1034,46 +2057,23 @@ int ktfs_delete(struct filesystem* fs, const char* name) {
     trace("some delete shenanigans\n");
 
 
-    int target_filetab_idx = -1;
-
-    int replacer_filetab_idx = -1;
-    for (int i = 0; i < ktfs_inst->max_inode_count; i++){
-        if (!records->filetab[i]) continue;
-        trace("name: %s, dentry_slot: %d\n",records->filetab[i]->dentry.name, records->filetab[i]->dentry_slot);
-        if (!strncmp(name, records->filetab[i]->dentry.name, KTFS_MAX_FILENAME_LEN)) target_filetab_idx = i;
-        if (records->filetab[i]->dentry_slot  == replacement_dentry){
-            trace("records->filetab[i]->dentry_slot: %d replacement_dentry: %d", records->filetab[i]->dentry_slot, replacement_dentry);
-            replacer_filetab_idx = i;
-        }
-    }
-
+    trace("replacement_dentry: %d\n", replacement_dentry);
 
-    trace("some delete shenanigans: target_filetab_idx: %d\n", target_filetab_idx);
-	
-
-    if (target_filetab_idx == -1){
-		trace("no file with that name exists\n");
-		return -ENOENT; //file not found
-	}
-    if (records->filetab[target_filetab_idx]->opened) {	
-		trace("doing delete on an open file smh\n");
-		return -EBUSY;
-	}
-
-
-    //if (!records->filetab[target_filetab_idx]) trace("ur mum"); 
-    //if (!records->filetab[replacer_filetab_idx]) trace("ur mum the sequel"); //this is a null
-
-	int target_dentry_slot = records->filetab[target_filetab_idx]->dentry_slot; //initial data
-    //int replacement_dentry_slot = records->filetab[replacer_filetab_idx]->dentry_slot;
-    int replacement_dentry_slot = replacement_dentry;
+    int replacement_dentry_slot = replacement_dentry; //the last dentry slot, whose file moves into the hole
     
     struct ktfs_dir_entry replacement_dentry_actual;
     struct ktfs_dir_entry target_dentry_actual; //will be useful later for when we 
 
     struct ktfs_inode target_inode;
 
-    memcpy(&target_inode,&records->filetab[target_filetab_idx]->inode_data, KTFS_INOSZ);
+    //the cached inode if the file has one (the table may not have caught up with it), the inode table otherwise
+    uint16_t target_inode_num = target_dentry.inode;
+    if (target_file != NULL && target_file->inode_loaded) target_inode = target_file->inode_data;
+    else {
+        if (cache_get_block_flags(ktfs_inst->cache_ptr, (target_inode_num/KTFS_NUM_INODES_IN_BLOCK + ktfs_inst->inode_block_start)*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, &blkptr) < 0) return -EIO;
+        memcpy(&target_inode, (struct ktfs_inode *)blkptr + target_inode_num%KTFS_NUM_INODES_IN_BLOCK, KTFS_INOSZ);
+        cache_release_block(ktfs_inst->cache_ptr, blkptr, 0);
+    }
             trace("line\n");
 
     if (target_dentry_slot == replacement_dentry_slot) { //no replacement case,
@@ -1082,14 +2082,18 @@ int ktfs_delete(struct filesystem* fs, const char* name) {
             int abs_blk_to_dealloc = ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &ktfs_inst->root_directory_inode_data, ktfs_inst->root_directory_inode_data.size/KTFS_BLKSZ);
 
             //I feel like copying it here is a good idea since another thread might come and allocate it as soon as free happens
-            cache_get_block(ktfs_inst->cache_ptr, abs_blk_to_dealloc*KTFS_BLKSZ, &blkptr);
+            cache_get_block_flags(ktfs_inst->cache_ptr, abs_blk_to_dealloc*KTFS_BLKSZ, CACHE_META, &blkptr);
             memcpy(&target_dentry_actual, blkptr, KTFS_DENSZ);//no real pointer math needed here nicely enough
             cache_release_block(ktfs_inst->cache_ptr, blkptr, 0); //no need to memset it to 0 either thats just a waste of time since its not readable anymore.
 
             ktfs_free_db_slot(ktfs_inst->cache_ptr, abs_blk_to_dealloc - ktfs_inst->data_block_start); // to my teammates, notice the conversion. both the free for the datablocks and the inodes is relative to the start of their sections
         }
         //free up the "live" bookkeppers tehat we set up in mount so that it doesn't conflict
-        records->filetab[target_filetab_idx] = NULL;
+        ktfs_name_remove(target_dentry_slot);
+        if (target_file != NULL){
+            target_file->inode_dirty = 0; //what it had is going away with the file
+            ktfs_file_put(target_file);
+        }
 
         //goto delete_cleanup;//yeah, I don't know why either
 
@@ -1099,8 +2103,6 @@ int ktfs_delete(struct filesystem* fs, const char* name) {
 
     kprintf("target_dentry_slot: %d\n", target_dentry_slot);
     kprintf("replacement_dentry_slot: %d\n", replacement_dentry_slot);
-    kprintf("replacer_filetab_idx: %d\n", replacer_filetab_idx);
-    kprintf("target_filetab_idx: %d\n", target_filetab_idx);
     kprintf("number of files after second delete case (for myself): %d\n", ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ);
 
         kprintf("YEAHHH PUNCH IT CHEWIE\n");
@@ -1113,37 +2115,41 @@ int ktfs_delete(struct filesystem* fs, const char* name) {
     kprintf("reached\n");
     
     //** please note that both of these are in ABSOLUTE indexed*/
-    int resident_blk_of_replacement_dentry = ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &ktfs_inst->root_directory_inode_data, ktfs_inst->root_directory_inode_data.size/KTFS_NUM_DENTRY_IN_BLOCK);
+    int resident_blk_of_replacement_dentry = ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &ktfs_inst->root_directory_inode_data, replacement_dentry_slot/KTFS_NUM_DENTRY_IN_BLOCK);
     int resident_blk_of_target_dentry = ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &ktfs_inst->root_directory_inode_data, target_dentry_slot/KTFS_NUM_DENTRY_IN_BLOCK);
     //note avain that the above function cooks even when the size is already decremented. see explanation for instance above.
     //TODO: wait this should actually happen way earlier. because if another thread DOES try to create, it has a ton of time to overlap.... can do it really easily towards the beginning but don't thats a later issue.
 
-    int abs_blk_to_dealloc = ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &ktfs_inst->root_directory_inode_data, ktfs_inst->root_directory_inode_data.size/KTFS_NUM_DENTRY_IN_BLOCK);//short replacement here works out regardless
-    cache_get_block(ktfs_inst->cache_ptr, resident_blk_of_replacement_dentry*KTFS_BLKSZ, &blkptr);//step one: get a copy of the replacer dentry
+    int abs_blk_to_dealloc = resident_blk_of_replacement_dentry; //the last dentry's block, which is emptied if that dentry was alone in it
+    cache_get_block_flags(ktfs_inst->cache_ptr, resident_blk_of_replacement_dentry*KTFS_BLKSZ, CACHE_META, &blkptr);//step one: get a copy of the replacer dentry
     memcpy(&replacement_dentry_actual, (struct ktfs_dir_entry *)blkptr + replacement_dentry_slot%KTFS_NUM_DENTRY_IN_BLOCK, KTFS_DENSZ);
     cache_release_block(ktfs_inst->cache_ptr, blkptr, 0); //there is no case where you have to move this. its instantly readable if you just decrement the size by -KTFS_DENSZ, which we did
     if (ktfs_inst->root_directory_inode_data.size % KTFS_BLKSZ == 0){
         ktfs_free_db_slot(ktfs_inst->cache_ptr, abs_blk_to_dealloc - ktfs_inst->data_block_start);//the dealloc end block case for the non-single remove
     }
 
-    cache_get_block(ktfs_inst->cache_ptr, resident_blk_of_target_dentry*KTFS_BLKSZ, &blkptr);
+    cache_get_block_flags(ktfs_inst->cache_ptr, resident_blk_of_target_dentry*KTFS_BLKSZ, CACHE_META, &blkptr);
     memcpy(&target_dentry_actual, (struct ktfs_dir_entry *)blkptr + target_dentry_slot%KTFS_NUM_DENTRY_IN_BLOCK, KTFS_DENSZ);
     memcpy((struct ktfs_dir_entry *)blkptr + target_dentry_slot%KTFS_NUM_DENTRY_IN_BLOCK, &replacement_dentry_actual,KTFS_DENSZ);//swapped out so that now the target dentry has what we need for replacement
     cache_release_block(ktfs_inst->cache_ptr, blkptr, 1);
 
     trace("line\n");
-    //take care of the bookeeping - recall the indicies we got a few: target_filetab_idx, replacer_filetab_idx, and we still have their
+    //take care of the bookeeping - recall the slots we got a few: target_dentry_slot and replacement_dentry_slot
     kprintf("target_dentry_slot: %d\n", target_dentry_slot);
     kprintf("replacement_dentry_slot: %d\n", replacement_dentry_slot);
-    kprintf("replacer_filetab_idx: %d\n", replacer_filetab_idx);
-    kprintf("target_filetab_idx: %d\n", target_filetab_idx);
     kprintf("number of files after second delete case (for myself): %d\n", ktfs_inst->root_directory_inode_data.size/KTFS_DENSZ);
 
-    trace("records->filetab[replacer_filetab_idx]->dentry_slot: %d\n", records->filetab[replacer_filetab_idx]->dentry_slot);
-
-    records->filetab[replacer_filetab_idx]->dentry_slot = target_dentry_slot;
-    
-    records->filetab[target_filetab_idx] = NULL;
+    //the target's record goes first, then the replacer (and its record, if it has one) moves into the target's slot
+    ktfs_name_remove(target_dentry_slot);
+    if (target_file != NULL){
+        target_file->inode_dirty = 0; //what it had is going away with the file
+        ktfs_file_put(target_file);
+    }
+    unsigned int replacement_hash = ktfs_inst->slot_hash[replacement_dentry_slot];
+    ktfs_name_remove(replacement_dentry_slot);
+    ktfs_name_insert(target_dentry_slot, replacement_hash);
+    struct ktfs_file * replacer_file = ktfs_file_find(replacement_dentry_slot);
+    if (replacer_file != NULL) ktfs_file_move(replacer_file, target_dentry_slot);
 
 
     
@@ -1152,38 +2158,11 @@ delete_cleanup:
 
     
     
-    ktfs_free_inode_slot(ktfs_inst->cache_ptr, target_dentry_actual.inode);//deallocate the inode. easy money (the inoed was already saved)
+    ktfs_free_inode_slot(ktfs_inst->cache_ptr, target_inode_num);//deallocate the inode. easy money (the inoed was already saved, and unlike target_dentry_actual it is set in both cases)
 
     //recall we saved the state of the target dentry. we also have the rdr data saved with the ktfs struct, so we can use that for convenience since we have 2hr left
 
-    int cont =0;
-
-    int tot = target_inode.size/KTFS_BLKSZ;
-    int flag_delete_indir_later = 0; //for tail deleteion
-
-    while (cont < tot){
-        if (cont >= KTFS_MAX_FILE_SIZE/KTFS_BLKSZ) return -ENOTSUP;
-
-        if (cont < KTFS_NUM_DIRECT_DATA_BLOCKS){
-            ktfs_free_db_slot(ktfs_inst->cache_ptr, target_inode.block[cont] - ktfs_inst->data_block_start);
-        }
-        else if (cont < 132){
-            if(cont == KTFS_NUM_DIRECT_DATA_BLOCKS) flag_delete_indir_later = 1; 
-            ktfs_free_db_slot(ktfs_inst->cache_ptr, ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &target_inode, cont) - ktfs_inst->data_block_start);
-        }
-        else {
-            ktfs_free_db_slot(ktfs_inst->cache_ptr, ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &target_inode, cont) - ktfs_inst->data_block_start);
-
-            //if (cont == 132+128*128-1) ktfs_free_db_slot(ktfs_inst->cache_ptr, ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &target_inode, cont) - ktfs_inst->data_block_start);
-            //if (cont == 132+128*128-1) ktfs_free_db_slot(ktfs_inst->cache_ptr, ktfs_get_block_absolute_idx(ktfs_inst->cache_ptr, &target_inode, cont) - ktfs_inst->data_block_start);
-
-        }
-        //else return 0;
-
-        cont++;
-    }
-    //exit free
-    if (flag_delete_indir_later) ktfs_free_db_slot(ktfs_inst->cache_ptr, target_inode.indirect);
+    ktfs_free_file_blocks(ktfs_inst->cache_ptr, &target_inode);
 
     return 0;
 
@@ -1210,15 +2189,12 @@ delete_cleanup:
 int ktfs_cntl(struct uio* uio, int cmd, void* arg) {
     // FIXME
 
-    struct ktfs_file * file = (void *)uio - offsetof(struct ktfs_file ,base);
+    struct ktfs_file_uio * fu = (void *)uio - offsetof(struct ktfs_file_uio ,base);
+    struct ktfs_file * file = fu->file;
+    int retval;
     //uint32_t size = file->inode_data.size;
     //trace("%s : size: %d\n", __func__, size);
 
-    if (!file->opened) {
-        trace("file wasn't opened yet");
-        return -EINVAL;
-    }
-
     switch (cmd)
     {
     case FCNTL_GETEND:
@@ -1232,28 +2208,35 @@ int ktfs_cntl(struct uio* uio, int cmd, void* arg) {
         
         //uint32_t end = *((uint32_t*)arg);
         uint32_t end = *((uint32_t*)arg);
-        if (end < file->inode_data.size) return -ENOTSUP; //we aren't supposed to support shortening files I'm pretty sure
-        if (end == file->inode_data.size) return 0;
-
-        int retval =  ktfs_appender(ktfs->cache_ptr, &file->inode_data, NULL, end - file->inode_data.size, F_APPEND_SETEND);
-        if (retval <0) return retval;
-        else return 0;
+        lock_acquire(&file->lock);
+        if (end < file->inode_data.size) retval = -ENOTSUP; //we aren't supposed to support shortening files I'm pretty sure
+        else if (end == file->inode_data.size) retval = 0;
+        else retval = ktfs_file_setend(fu, end); //the new part is a hole, nothing gets written
+        lock_release(&file->lock);
+        return retval;
         break;
 
     case FCNTL_GETPOS:
 
-        *((uint32_t*)arg) = file->pos; // FCNTL_GETPOS should pass back the current position of the file pointer in bytes through * the arg variable
+        *((uint32_t*)arg) = fu->pos; // FCNTL_GETPOS should pass back the current position of the file pointer in bytes through * the arg variable
         return 0;
 
         break;
 
     case FCNTL_SETPOS: 
 
-        file->pos = *((uint32_t*)arg); // FCNTL_SETPOS should set the current position of the file pointer to the value passed in * through arg
+        fu->pos = *((uint32_t*)arg); // FCNTL_SETPOS should set the current position of the file pointer to the value passed in * through arg
         return 0 ;
 
         break;
 
+    case FCNTL_DIRECT:
+
+        fu->direct = (*((int*)arg) != 0); // reads and writes of any length skip the cache from here on (see ktfs_fetch, ktfs_store)
+        return 0;
+
+        break;
+
     default:
         break;
     }
@@ -1272,6 +2255,19 @@ void ktfs_flush(struct filesystem* fs) {
     // EDGE CASE : Check if cache exists
     if(ktfs->cache_ptr == NULL) return;// -EINVAL ;
 
+    //cached inodes go to the inode table first, so the flush takes them to the disk along with the data. a record
+    //kept only for its dirty inode can go once that's done. the chain may change while a writeback waits, so it's
+    //walked again from the start after each one that goes through (one that doesn't leaves the record where it was)
+    for (int b = 0; b < KTFS_FILE_BUCKETS; b++){
+        struct ktfs_file * file = ktfs->file_heads[b];
+        while (file != NULL){
+            if (file->inode_dirty && ktfs_inode_writeback(file) == 0){
+                ktfs_file_put(file);
+                file = ktfs->file_heads[b];
+            } else file = file->next;
+        }
+    }
+
     // Return val for success (0) and negative error code handled in cache_flush NOT NEEDED
     //int retval = 
     cache_flush(ktfs->cache_ptr) ;
@@ -1302,55 +2298,37 @@ void ktfs_listing_close(struct uio* uio) {
  */
 long ktfs_listing_read(struct uio* uio, void* buf, unsigned long bufsz) {
     struct ktfs_listing_uio *const ls = (struct ktfs_listing_uio *)uio;
+    struct ktfs_dir_entry * dentry_block = NULL;
+    int nslots = ktfs->root_directory_inode_data.size/KTFS_DENSZ;
+    int retval;
 
-    if (ls->records == NULL) return -EINVAL;
-    //kprintf("listing enter\n");
-    int nfiles = ktfs->max_inode_count;
-
-    // int ncpy = 0;//number of bytes copied
-    // for (int i = 0; i < nfiles; i++){ 
-    //     if (!ls->records->filetab[i]) continue;
-    //     char * name = ls->records->filetab[i]->dentry.name;
-    //     if (ncpy+strlen(name)+1 >= bufsz) break; //TODO: make sure this is right.... I mean the only difference I see in impl is whether i output them as seperate stirngs or one big string of FILE_NAME_MAX_LEN size
-    //     memcpy((char *)buf+ncpy, name, strlen(name));
-    //     memset((char *)buf+(ncpy+strlen(name)+1), 0, 1);//note: accounted for the null-terminator here
-    //     ncpy += strlen(name)+1;
-    // }
-    
-
-    //new clean implementation
+    //names come from the directory blocks (there's no record of a file that isn't open), one block held at a time. a
+    //hashed directory has free dentries among them
     int ncpy = 0;
-    while (ls->read_idx < nfiles){ 
-        if (!ls->records->filetab[ls->read_idx])
-        {
-            ls->read_idx++;
-            continue;
+    while (ls->read_idx < nslots){ 
+        if (bufsz-ncpy <= 0) break;
+
+        if (dentry_block == NULL){
+            int absolute_idx = ktfs_get_block_absolute_idx(ktfs->cache_ptr, &ktfs->root_directory_inode_data, ls->read_idx/KTFS_NUM_DENTRY_IN_BLOCK);
+            if (absolute_idx < 0) return ncpy ? ncpy : absolute_idx;
+            retval = cache_get_block_flags(ktfs->cache_ptr, absolute_idx*KTFS_BLKSZ, CACHE_SHARED | CACHE_META, (void **)&dentry_block);
+            if (retval < 0) return ncpy ? ncpy : retval;
         }
-        //kprintf("bufsz: %d\n", bufsz);
-        //kprintf("ncpy: %d\n", ncpy);
+        const char * name = dentry_block[ls->read_idx%KTFS_NUM_DENTRY_IN_BLOCK].name;
 
-        if (bufsz-ncpy <= 0) {
-            //kprintf("return???\n");
-            return ncpy;
-        }
-        int nread = snprintf((char *)buf+ncpy, bufsz-ncpy, "%s", ls->records->filetab[ls->read_idx]->dentry.name);
-        // kprintf("name: %s\n", ((char *)buf+ncpy));
-        // kprintf("nread: %d\n", nread);
-        // kprintf("strlen of name: %d", strlen(ls->records->filetab[ls->read_idx]->dentry.name));
-        //kprintf("buffer: %s\n", buf);
-
-        if (nread != strlen(ls->records->filetab[ls->read_idx]->dentry.name)+1) {
-            //kprintf("returned\n");
-            return ncpy;
+        if (name[0] != '\0'){
+            int nread = snprintf((char *)buf+ncpy, bufsz-ncpy, "%s", name);
+            if (nread != strlen(name)+1) break;
+            ((char *)buf)[ncpy+nread-1] = '\r'; //I lowk want the last char to be a cariage return
+            ncpy += nread;
         }
-
-        //kprintf("ls->read_idx = %d\n", ls->read_idx);
-        if (ls->read_idx < nfiles) ((char *)buf)[ncpy+nread-1] = '\r'; //I lowk want the last char to be a cariage return
-        
-        ncpy += nread;
         ls->read_idx++;
+        if (ls->read_idx % KTFS_NUM_DENTRY_IN_BLOCK == 0){
+            cache_release_block(ktfs->cache_ptr, dentry_block, 0);
+            dentry_block = NULL;
+        }
     }
+    if (dentry_block != NULL) cache_release_block(ktfs->cache_ptr, dentry_block, 0);
     
     return ncpy;
 }
-
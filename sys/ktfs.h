@@ -33,6 +33,10 @@
 #define KTFS_NO_ALLOCATION 0
 #define KTFS_ALLOCATE 1
 
+#define KTFS_FEATURE_HASHDIR (1 << 0) // the root directory is hashed (see below)
+#define KTFS_DENTRY_DELETED 0xFFFF // inode number of a deleted dentry in a hashed directory
+#define KTFS_HOLE 0xFFFFFFFF // block index of a file block that has no block (see below)
+
 /*
 Overall filesystem image layout
 
@@ -79,6 +83,32 @@ struct filesystem {
 
 NOTE: The ((packed)) attribute is used to ensure that the struct is packed and
 there is no padding between the members or struct alignment requirements.
+
+Root directory
+
+The root directory is a file of struct ktfs_dir_entry. In the flat layout (what
+mkfs_ktfs makes) the dentries are packed from the start of it: create appends,
+and delete moves the last dentry into the hole, so a name can only be found by
+reading them all.
+
+With KTFS_FEATURE_HASHDIR set (util/hashdir_ktfs converts an image) it's
+dir_bucket_count blocks instead, a power of two, and its size covers all of
+them. A name goes in block ktfs_name_hash(name) & (dir_bucket_count - 1), or
+if that's full, the first block after it (wrapping around) that has room. A
+dentry whose name starts with '\0' is free: never used if its inode is 0,
+deleted if it's KTFS_DENTRY_DELETED. A lookup reads blocks from the name's own
+block on and can stop at the first one with a never used dentry, since a
+create would have put the name there, so it reads one block unless the
+directory is nearly full. Dentries never move.
+
+Holes
+
+A block index of KTFS_HOLE in an inode or an index block means the file has
+no block there, and it reads as zeros (data block 0 is a real block, so 0
+can't mean that). An indirect or doubly-indirect index of KTFS_HOLE makes
+every block under it a hole. Growing a file with FCNTL_SETEND makes the new
+blocks holes, and a store into a hole gives it a block. Index blocks start
+out all holes.
 */
 
 // Superblock
@@ -98,6 +128,12 @@ struct ktfs_superblock {
 
     /// The root directory inode number
     uint16_t root_directory_inode;
+
+    /// KTFS_FEATURE_* flags. 0 for an image straight from mkfs_ktfs
+    uint16_t features;
+
+    /// Blocks in a hashed root directory (KTFS_FEATURE_HASHDIR), a power of two
+    uint32_t dir_bucket_count;
 } __attribute__((packed));
 
 // Inode with indirect and doubly-indirect blocks
@@ -128,3 +164,18 @@ struct ktfs_bitmap {
 struct ktfs_data_block {
     uint8_t data[KTFS_BLKSZ];
 } __attribute__((packed));
+
+/**
+ * @brief FNV-1a hash of a file name, over the same KTFS_MAX_FILENAME_LEN characters strncmp compares. a hashed
+ * directory puts names by it, so it's part of the format
+ * @param name file name
+ * @return hash of the name
+ */
+static inline unsigned int ktfs_name_hash(const char* name) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < (KTFS_MAX_FILENAME_LEN) && name[i] != '\0'; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
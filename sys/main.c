@@ -19,6 +19,7 @@
 #include "heap.h"
 #include "intr.h"
 #include "process.h"
+#include "riscv.h"
 #include "string.h"
 #include "thread.h"
 #include "timer.h"
@@ -31,6 +32,10 @@
 #define DEVMNTNAME "dev"
 #define CDEVNAME "vioblk"
 #define CDEVINST 0
+#define CDEVCACHECAP 512  // blocks cached for the C drive (256 KB)
+#ifndef CDEVCACHEMODE
+#define CDEVCACHEMODE CACHE_MODE_PAGE  // the C drive cache works in 4 KB lines
+#endif
 
 #ifndef NUART  // number of UARTs
 #define NUART 2
@@ -90,6 +95,9 @@ void attach_devices(void) {
 void mount_cdrive(void) {
     struct storage* hd;
     struct cache* cache;
+#if BOOT_TIMING
+    unsigned long long t0;
+#endif
     int result;
 
     hd = find_storage(CDEVNAME, CDEVINST);
@@ -106,13 +114,16 @@ void mount_cdrive(void) {
         halt_failure();
     }
 
-    result = create_cache(hd, &cache);
+    result = create_cache_mode(hd, CDEVCACHECAP, CDEVCACHEMODE, &cache);
 
     if (result != 0) {
         kprintf("create_cache(%s%d) failed: %s\n", CDEVNAME, CDEVINST, error_name(result));
         halt_failure();
     }
 
+#if BOOT_TIMING
+    t0 = rdtime();
+#endif
     result = mount_ktfs(CMNTNAME, cache);
 
     if (result != 0) {
@@ -120,6 +131,10 @@ void mount_cdrive(void) {
                 error_name(result));
         halt_failure();
     }
+#if BOOT_TIMING
+    kprintf("mounted %s in %llu us (metadata warm-up %s)\n", CMNTNAME,
+            (rdtime() - t0) * 1000000 / TIMER_FREQ, KTFS_MOUNT_WARMUP ? "on" : "off");
+#endif
 }
 
 
@@ -129,6 +144,9 @@ void run_init(void) {
     struct uio* initexe;
     struct uio* uart_dev;
     struct uio* ramdisk_dev;
+#if BOOT_TIMING
+    unsigned long long t0 = rdtime();
+#endif
     int result;
 
     result = open_file(CMNTNAME, INITEXE, &initexe);
@@ -137,6 +155,9 @@ void run_init(void) {
         kprintf(INITEXE ": %s; terminating\n", error_name(result));
         halt_failure();
     }
+#if BOOT_TIMING
+    kprintf("first open (" INITEXE ") took %llu us\n", (rdtime() - t0) * 1000000 / TIMER_FREQ);
+#endif
 
     // result = open_file(DEVMNTNAME, "uart1", &uart_dev);
     // //result = open_file(DEVMNTNAME, "ramdisk0", &ramdisk_dev);
@@ -93,7 +93,7 @@ void mount_cdrive(void) {
         halt_failure();
     }
 
-    result = create_cache(hd, &cache);
+    result = create_cache(hd, 0, &cache);
 
     if (result != 0) {
         kprintf("create_cache(%s%d) failed: %s\n", CDEVNAME, CDEVINST, error_name(result));
@@ -22,8 +22,10 @@
 #include "console.h"
 #include "intr.h"
 #include "device.h"
+#include "devimpl.h"
 #include "thread.h"
 #include "heap.h"
+#include "memory.h"
 #include "dev/rtc.h"
 #include "dev/uart.h"
 #include "dev/virtio.h"
@@ -33,8 +35,29 @@
 #include "filesys.h"
 #include "error.h"
 #include "cache.h"
+#include "riscv.h"
 
+#define BENCH_LOOKUPS 20000
+#define SCRATCH_BLKS 16384 // blocks the scratch disk says it has
+#define SCRATCH_BACKED_PAGES 16 // pages at the front of it that keep what's written (the first 128 blocks)
+#define BENCH_ROUNDS 200
+#define BENCH_STREAM 60 // blocks streamed per round, a bit under the cache size
 
+//a disk in memory for the benches and tests to make caches over, so they never write the mounted drive.
+//only the front of it is kept, past that it reads as zeros and drops what's written
+struct scratch_disk {
+    struct storage base; //must be first
+    char * data; //the first nbacked bytes
+    unsigned long long nbacked;
+};
+
+static long scratch_fetch(struct storage * sto, unsigned long long pos, void * buf, unsigned long bytecnt);
+static long scratch_store(struct storage * sto, unsigned long long pos, const void * buf, unsigned long bytecnt);
+
+static const struct storage_intf scratch_intf = {
+    .blksz = CACHE_BLKSZ, .fetch = &scratch_fetch, .store = &scratch_store};
+
+static struct scratch_disk scratch;
 
 // Add args, structs, includes, defines
 void run_cache_tests() {
@@ -45,6 +68,48 @@ void run_cache_tests() {
     // test_output = (retval == 0) ? "test1 passed!" : "test1 failed!"; 
     // kprintf("%s\n", test_output);
     observe_cache_lru();
+    bench_cache_lookup();
+    bench_cache_readahead();
+    bench_cache_policy();
+    bench_cache_lines();
+    bench_cache_direct();
+    test_cache_store_direct();
+    test_cache_stats();
+}
+
+//the scratch disk, set up the first time it's asked for. NULL if its pages can't be had
+static struct storage * scratch_storage(void){
+    if (scratch.data == NULL){
+        scratch.data = alloc_phys_pages(SCRATCH_BACKED_PAGES);
+        if (scratch.data == NULL) return NULL;
+        memset(scratch.data, 0, SCRATCH_BACKED_PAGES * PAGE_SIZE);
+        scratch.nbacked = SCRATCH_BACKED_PAGES * PAGE_SIZE;
+        storage_init(&scratch.base, &scratch_intf, (unsigned long long)SCRATCH_BLKS * CACHE_BLKSZ);
+    }
+    return &scratch.base;
+}
+
+static long scratch_fetch(struct storage * sto, unsigned long long pos, void * buf, unsigned long bytecnt){
+    struct scratch_disk * const disk = (struct scratch_disk *)sto;
+    unsigned long kept = 0;
+
+    if (pos >= sto->capacity) return 0;
+    if (bytecnt > sto->capacity - pos) bytecnt = sto->capacity - pos;
+    if (pos < disk->nbacked){
+        kept = MIN(bytecnt, disk->nbacked - pos);
+        memcpy(buf, disk->data + pos, kept);
+    }
+    memset((char *)buf + kept, 0, bytecnt - kept);
+    return bytecnt;
+}
+
+static long scratch_store(struct storage * sto, unsigned long long pos, const void * buf, unsigned long bytecnt){
+    struct scratch_disk * const disk = (struct scratch_disk *)sto;
+
+    if (pos >= sto->capacity) return 0;
+    if (bytecnt > sto->capacity - pos) bytecnt = sto->capacity - pos;
+    if (pos < disk->nbacked) memcpy(disk->data + pos, buf, MIN(bytecnt, disk->nbacked - pos));
+    return bytecnt;
 }
 
 //this test has no output. its jjust to observe the flow
@@ -88,3 +153,351 @@ int test_lru_concurrency(){
     //at this point lru should be block 0. so 
     
 }
+
+
+//times BENCH_LOOKUPS hits and BENCH_LOOKUPS misses through cache_get_block() and cache_release_block() on a fresh
+//plain LRU cache of n blocks over the scratch disk that finds its lines with the given lookup, and hands back the
+//average ns per get and release. the cache holds the even blocks below 2 * n and the misses cycle through twice as
+//many odd ones, so under LRU every one of them misses
+static int bench_lookup_run(struct storage * sd, int n, int lookup, unsigned long long * hit_ns, unsigned long long * miss_ns){
+    struct cache_stats before, after;
+    struct cache * cache;
+    unsigned long long t0;
+    void * blk;
+    int retval;
+
+    if ((retval = create_cache(sd, n, &cache)) < 0) return retval;
+    cache_set_policy(cache, CACHE_POLICY_LRU);
+    cache_set_lookup(cache, lookup);
+
+    for (int i = 0; i < n; i++){
+        if (cache_get_block(cache, (unsigned long long)(2 * i) * CACHE_BLKSZ, &blk) < 0) break;
+        cache_release_block(cache, blk, 0);
+    }
+
+    cache_get_stats(cache, &before);
+    t0 = rdtime();
+    for (int i = 0; i < BENCH_LOOKUPS; i++){
+        if (cache_get_block(cache, (unsigned long long)(2 * ((i * 7) % n)) * CACHE_BLKSZ, &blk) < 0) break;
+        cache_release_block(cache, blk, 0);
+    }
+    *hit_ns = (rdtime() - t0) * (1000000000UL / TIMER_FREQ) / BENCH_LOOKUPS;
+    cache_get_stats(cache, &after);
+    if (after.hits - before.hits != BENCH_LOOKUPS)
+        kprintf("%s: %d | only %llu of the hits hit\n", __func__, n, after.hits - before.hits);
+
+    t0 = rdtime();
+    for (int i = 0; i < BENCH_LOOKUPS; i++){
+        if (cache_get_block(cache, (unsigned long long)(2 * (i % (2 * n)) + 1) * CACHE_BLKSZ, &blk) < 0) break;
+        cache_release_block(cache, blk, 0);
+    }
+    *miss_ns = (rdtime() - t0) * (1000000000UL / TIMER_FREQ) / BENCH_LOOKUPS;
+
+    destroy_cache(cache);
+    return 0;
+}
+
+//runs the same hit and miss loops on caches of 64, 512 and 4096 blocks, first finding lines by scanning every
+//slot (the lookup the position index replaced) and then through the index, and prints both. a miss also pays for
+//an eviction and a copy from the scratch disk, the same on both sides, so the gap between the columns is the lookup.
+//a size whose cache doesn't fit in memory is skipped
+int bench_cache_lookup(){
+    static const int sizes[] = { 64, 512, 4096 };
+    struct storage * sd = scratch_storage();
+
+    kprintf("%s: capacity | scan hit ns | scan miss ns | hash hit ns | hash miss ns\n", __func__);
+    for (int s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+        int n = sizes[s];
+        unsigned long long scan_hit, scan_miss, hash_hit, hash_miss;
+        int retval;
+
+        if (sd == NULL || (retval = bench_lookup_run(sd, n, CACHE_LOOKUP_SCAN, &scan_hit, &scan_miss)) == -ENOMEM){
+            kprintf("%s: %d | no room for the cache\n", __func__, n);
+            continue;
+        }
+        if (retval < 0) return retval;
+        if ((retval = bench_lookup_run(sd, n, CACHE_LOOKUP_HASH, &hash_hit, &hash_miss)) < 0) return retval;
+
+        kprintf("%s: %d | %llu | %llu | %llu | %llu\n", __func__, n, scan_hit, scan_miss, hash_hit, hash_miss);
+    }
+    return 0;
+}
+
+//reads blocks [first, first + n) (or n pseudo-random blocks below first + n) through the cache and
+//prints the time taken along with the cache's hit rate and read-ahead use
+static void bench_readahead_pass(struct cache * cache, const char * name, int random, int first, int n){
+    struct cache_stats before, after;
+    unsigned long long t0, t;
+    unsigned int seed = 1;
+    void * blk;
+
+    cache_get_stats(cache, &before);
+    t0 = rdtime();
+    for (int i = 0; i < n; i++){
+        int b = first + i;
+        if (random){
+            seed = seed * 1103515245 + 12345;
+            b = first + (seed >> 8) % n;
+        }
+        if (cache_get_block(cache, (unsigned long long)b * CACHE_BLKSZ, &blk) < 0){
+            kprintf("%s: %s: cache_get_block(%d) failed\n", __func__, name, b);
+            return;
+        }
+        cache_release_block(cache, blk, 0);
+    }
+    t = rdtime() - t0;
+    cache_get_stats(cache, &after);
+
+    kprintf("%s: %s | %llu us | %llu hits | %llu misses | %llu read ahead | %llu wasted\n", __func__, name,
+        t * 1000000 / TIMER_FREQ,
+        after.hits - before.hits, after.misses - before.misses,
+        after.prefetched - before.prefetched, after.prefetch_wasted - before.prefetch_wasted);
+}
+
+//sequential and random reads of the scratch disk through a fresh 64 block cache. the sequential pass
+//should turn most misses into read-ahead hits, the random one should read ahead next to nothing
+int bench_cache_readahead(){
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+
+    if (sd == NULL || create_cache(sd, 64, &cache) < 0){
+        kprintf("%s: no cache over the scratch disk\n", __func__);
+        return -EINVAL;
+    }
+    bench_readahead_pass(cache, "sequential", 0, 0, 1024);
+    bench_readahead_pass(cache, "random", 1, 1024, 1024);
+    return destroy_cache(cache);
+}
+
+//one policy run of bench_cache_policy: each round streams the next BENCH_STREAM blocks of a 1000
+//block region, then "opens" a small file (superblock, inode bitmap, two inode blocks, one of four
+//directory blocks) and reads two of its data blocks. returns the misses taken on the metadata blocks
+static long bench_policy_pass(struct cache * cache, int meta_flags){
+    static const int meta_blks[] = {0, 1, 10, 11, 12};
+    struct cache_stats before, after;
+    long meta_misses = 0;
+    int stream = 0;
+    void * blk;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        for (int i = 0; i < BENCH_STREAM; i++){
+            if (cache_get_block_flags(cache, (unsigned long long)(2000 + stream++ % 1000) * CACHE_BLKSZ, CACHE_SHARED, &blk) < 0) return -EIO;
+            cache_release_block(cache, blk, 0);
+        }
+        for (int i = 0; i <= sizeof(meta_blks) / sizeof(meta_blks[0]); i++){
+            int b = (i < sizeof(meta_blks) / sizeof(meta_blks[0])) ? meta_blks[i] : 20 + round % 4;
+
+            cache_get_stats(cache, &before);
+            if (cache_get_block_flags(cache, (unsigned long long)b * CACHE_BLKSZ, CACHE_SHARED | meta_flags, &blk) < 0) return -EIO;
+            cache_release_block(cache, blk, 0);
+            cache_get_stats(cache, &after);
+            meta_misses += after.misses - before.misses;
+        }
+        for (int i = 0; i < 2; i++){
+            if (cache_get_block_flags(cache, (unsigned long long)(100 + round % 8 * 2 + i) * CACHE_BLKSZ, CACHE_SHARED, &blk) < 0) return -EIO;
+            cache_release_block(cache, blk, 0);
+        }
+    }
+    return meta_misses;
+}
+
+//metadata misses of a small-file workload running next to a streaming reader, under plain LRU, 2Q,
+//and 2Q with the metadata blocks asked for with CACHE_META (what ktfs does). each run gets a fresh
+//64 block cache over the scratch disk. LRU should lose the metadata to every round's stream, 2Q should not
+int bench_cache_policy(){
+    static const char * const names[] = {"lru", "2q", "2q+meta"};
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+    long misses;
+
+    for (int run = 0; run < 3; run++){
+        if (sd == NULL || create_cache(sd, 64, &cache) < 0){
+            kprintf("%s: no cache over the scratch disk\n", __func__);
+            return -EINVAL;
+        }
+        cache_set_policy(cache, (run == 0) ? CACHE_POLICY_LRU : CACHE_POLICY_2Q);
+        misses = bench_policy_pass(cache, (run == 2) ? CACHE_META : 0);
+        destroy_cache(cache);
+        if (misses < 0){
+            kprintf("%s: %s: cache_get_block_flags failed\n", __func__, names[run]);
+            return misses;
+        }
+        kprintf("%s: %s | %ld metadata misses over %d opens\n", __func__, names[run], misses, BENCH_ROUNDS);
+    }
+    return 0;
+}
+
+//the passes of bench_cache_readahead again, over a fresh cache of the same size in page lines. every
+//miss reads a whole 4 KB line, in place of one block plus whatever read-ahead decides on
+int bench_cache_lines(){
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+
+    if (sd == NULL || create_cache_mode(sd, 64, CACHE_MODE_PAGE, &cache) < 0){
+        kprintf("%s: no cache over the scratch disk\n", __func__);
+        return -EINVAL;
+    }
+    bench_readahead_pass(cache, "page sequential", 0, 0, 1024);
+    bench_readahead_pass(cache, "page random", 1, 1024, 1024);
+    return destroy_cache(cache);
+}
+
+//reads the same 1024 blocks of the scratch disk through a fresh cache (cache_get_blocks and a copy out) and then past it
+//(cache_fetch_direct into a page buffer, 16 pages per request), and prints the time each took
+int bench_cache_direct(){
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+    void * blks[CACHE_IO_MAX];
+    unsigned long long t0, t_cached, t_direct;
+    char * buf;
+    long retval;
+
+    if (sd == NULL || create_cache(sd, 64, &cache) < 0){
+        kprintf("%s: no cache over the scratch disk\n", __func__);
+        return -EINVAL;
+    }
+    buf = alloc_phys_pages(16);
+    if (buf == NULL){
+        destroy_cache(cache);
+        return -ENOMEM;
+    }
+
+    t0 = rdtime();
+    for (int b = 0; b < 1024; b += CACHE_IO_MAX){
+        int n = MIN(CACHE_IO_MAX, 1024 - b);
+        if (cache_get_blocks(cache, (unsigned long long)b * CACHE_BLKSZ, n, CACHE_SHARED, blks) < 0){
+            kprintf("%s: cache_get_blocks(%d) failed\n", __func__, b);
+            free_phys_pages(buf, 16);
+            destroy_cache(cache);
+            return -EIO;
+        }
+        for (int i = 0; i < n; i++) memcpy(buf + (b + i) % 128 * CACHE_BLKSZ, blks[i], CACHE_BLKSZ);
+        cache_release_blocks(cache, blks, n, 0);
+    }
+    t_cached = rdtime() - t0;
+
+    t0 = rdtime();
+    for (int b = 0; b < 1024; b += 128){
+        retval = cache_fetch_direct(cache, (unsigned long long)b * CACHE_BLKSZ, buf, 128 * CACHE_BLKSZ);
+        if (retval < 0){
+            kprintf("%s: cache_fetch_direct(%d) failed: %s\n", __func__, b, error_name(retval));
+            free_phys_pages(buf, 16);
+            destroy_cache(cache);
+            return retval;
+        }
+    }
+    t_direct = rdtime() - t0;
+
+    kprintf("%s: 1024 blocks | cached %llu us | direct %llu us\n", __func__,
+        t_cached * 1000000 / TIMER_FREQ, t_direct * 1000000 / TIMER_FREQ);
+    free_phys_pages(buf, 16);
+    return destroy_cache(cache);
+}
+
+//writes 16 blocks of the scratch disk past a fresh cache with cache_store_direct while one of them is cached dirty
+//with other data and another is cached clean, and checks that both cached copies and the disk end up with what was
+//written (a stale dirty copy written back later would undo the store)
+int test_cache_store_direct(){
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+    struct cache_stats stats;
+    unsigned long long pos = 64 * CACHE_BLKSZ; //inside the part of the scratch disk that's kept
+    char * buf, * check;
+    void * blk;
+    int result = 0;
+    long retval;
+
+    if (sd == NULL || create_cache(sd, 64, &cache) < 0){
+        kprintf("%s: no cache over the scratch disk\n", __func__);
+        return -EINVAL;
+    }
+    buf = alloc_phys_pages(4);
+    if (buf == NULL){
+        destroy_cache(cache);
+        return -ENOMEM;
+    }
+    check = buf + 2 * PAGE_SIZE;
+    for (int i = 0; i < 16 * CACHE_BLKSZ; i++) buf[i] = i * 7 + 1;
+
+    retval = cache_get_block(cache, pos + 3 * CACHE_BLKSZ, &blk);
+    if (retval >= 0){
+        memset(blk, 0xAA, CACHE_BLKSZ);
+        cache_release_block(cache, blk, 1);
+        retval = cache_get_block_flags(cache, pos + 5 * CACHE_BLKSZ, CACHE_SHARED, &blk);
+    }
+    if (retval >= 0){
+        cache_release_block(cache, blk, 0);
+        retval = cache_store_direct(cache, pos, buf, 16 * CACHE_BLKSZ);
+    }
+    if (retval != 16 * CACHE_BLKSZ){
+        kprintf("%s: setup or store failed: %ld\n", __func__, retval);
+        free_phys_pages(buf, 4);
+        destroy_cache(cache);
+        return -EIO;
+    }
+
+    for (int b = 3; b <= 5; b += 2){
+        if (cache_get_block(cache, pos + b * CACHE_BLKSZ, &blk) < 0){
+            result = -EIO;
+            continue;
+        }
+        if (memcmp(blk, buf + b * CACHE_BLKSZ, CACHE_BLKSZ) != 0){
+            kprintf("%s: cached block %d doesn't have the new data\n", __func__, b);
+            result = -EINVAL;
+        }
+        cache_release_block(cache, blk, 0);
+    }
+    cache_flush(cache);
+    if (cache_fetch_direct(cache, pos, check, 16 * CACHE_BLKSZ) != 16 * CACHE_BLKSZ
+        || memcmp(check, buf, 16 * CACHE_BLKSZ) != 0){
+        kprintf("%s: the disk doesn't have the new data\n", __func__);
+        result = -EINVAL;
+    }
+
+    cache_get_stats(cache, &stats);
+    if (stats.direct_stores != 16){
+        kprintf("%s: %llu blocks counted as stored direct, not 16\n", __func__, stats.direct_stores);
+        result = -EINVAL;
+    }
+    free_phys_pages(buf, 4);
+    destroy_cache(cache);
+    return result;
+}
+
+//runs a mixed workload over a fresh 64 block cache of the scratch disk and prints every counter, then checks
+//that cache_reset_stats() zeroes them
+int test_cache_stats(){
+    struct storage * sd = scratch_storage();
+    struct cache * cache;
+    struct cache_stats stats;
+    void * blk;
+
+    if (sd == NULL || create_cache(sd, 64, &cache) < 0){
+        kprintf("%s: no cache over the scratch disk\n", __func__);
+        return -EINVAL;
+    }
+    for (int i = 0; i < 256; i++){
+        int b = (i % 4 == 0) ? i / 4 % 16 : 1024 + i;
+        if (cache_get_block(cache, (unsigned long long)b * CACHE_BLKSZ, &blk) < 0){
+            kprintf("%s: cache_get_block(%d) failed\n", __func__, b);
+            destroy_cache(cache);
+            return -EIO;
+        }
+        cache_release_block(cache, blk, i % 8 == 0);
+    }
+    cache_flush(cache);
+
+    cache_get_stats(cache, &stats);
+    kprintf("%s: %llu hits | %llu misses | %llu evictions | %llu write-backs (%llu sync) | %llu pin waits | %llu us fetching\n",
+        __func__, stats.hits, stats.misses, stats.evictions, stats.writebacks, stats.sync_stores, stats.pin_waits,
+        stats.fetch_ticks * 1000000 / TIMER_FREQ);
+
+    cache_reset_stats(cache);
+    cache_get_stats(cache, &stats);
+    destroy_cache(cache);
+    if (stats.hits || stats.misses || stats.evictions || stats.writebacks || stats.fetch_ticks){
+        kprintf("%s: counters not zero after cache_reset_stats\n", __func__);
+        return -EINVAL;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -5,5 +5,12 @@
 // Add args if you want
 void run_cache_tests(void);
 int  observe_cache_lru(void);
+int  bench_cache_lookup(void); //times cache_get_block hits and misses on caches of 64, 512 and 4096 blocks, scan lookup against the hash index
+int  bench_cache_readahead(void); //hit rate and read-ahead use for sequential vs random block reads
+int  bench_cache_policy(void); //metadata misses next to a streaming reader under LRU, 2Q and 2Q with CACHE_META
+int  bench_cache_lines(void); //bench_cache_readahead's passes over a cache in page sized lines
+int  bench_cache_direct(void); //time to read 1024 blocks through the cache vs past it with cache_fetch_direct
+int  test_cache_store_direct(void); //cache_store_direct past a cache holding stale copies of the blocks, then checks both
+int  test_cache_stats(void); //prints every cache counter after a mixed workload, then checks cache_reset_stats
 
 #endif // _TESTSUITE_1_H_
@@ -6,6 +6,7 @@
 #include "device.h"
 #include "thread.h"
 #include "heap.h"
+#include "memory.h"
 #include "dev/rtc.h"
 #include "dev/uart.h"
 #include "dev/virtio.h"
@@ -15,6 +16,7 @@
 #include "filesys.h"
 #include "error.h"
 #include "cache.h"
+#include "riscv.h"
 #include <stdint.h>
 
 //from the test_main file 
@@ -26,6 +28,17 @@
 
 #define LOREM_BYTE_LEN 273284
 #define BEE_MOVIE_BYTE_LEN 148423
+#define ABENCH_BLKS 64 // blocks appended per timed store
+#define ABENCH_FILE_BLKS 128 // size of each filler file, in blocks
+#define ABENCH_MAX_FILES 256
+#define LBENCH_HEAD 16 // blocks the file starts with
+#define LBENCH_GROW 112 // blocks it grows by later
+#define MBENCH_BLKS 1024 // file size for the block map bench, well into the doubly-indirect blocks
+#define SBENCH_RECS 512 // records appended by the small append bench
+#define SBENCH_RECSZ 64 // bytes in each of them
+#define FBENCH_FILES 5000 // files the many files bench fills the directory up to
+#define HTEST_BLKS 282 // size of the sparse file test's file, in blocks: into the first doubly-indirect tree
+#define HBENCH_BLKS 16384 // size the SETEND bench grows a file to, in blocks: more than most images have
 
 static char buff1[BEE_MOVIE_BYTE_LEN];
 static char buff2[BEE_MOVIE_BYTE_LEN];
@@ -44,6 +57,16 @@ void run_ktfs_highlevel_tests() {
     //test_ktfs_multiclose(); //unused
 	
 	test_ktfs_store_precision();
+    test_ktfs_name_index();
+    test_ktfs_concurrent_open();
+    test_ktfs_direct_io();
+    test_ktfs_sparse();
+    bench_ktfs_alloc();
+    bench_ktfs_layout();
+    bench_ktfs_blockmap();
+    bench_ktfs_small_append();
+    bench_ktfs_many_files();
+    bench_ktfs_setend();
     //test_ktfs_unfoundopen(); 
     //test_ktfs_fetch_dindirection();
     //kprintf("reached\n");
@@ -146,13 +169,15 @@ int test_ktfs_multiopen() {
 
     
     //kprintf("reached\n");
-    retval = open_file("c","bee_movie.txt",&uio);
-    if (retval ==0) { 
-    kprintf("%s: unintended behavior. ktfs opened the same file twice\n", __func__);
+    struct uio * again;
+    retval = open_file("c","bee_movie.txt",&again);
+    if (retval <0 || again == uio) { 
+    kprintf("%s: unintended behavior. every open of a file should get its own uio\n", __func__);
     halt_failure();
-    } else kprintf("%s: ktfs failed to open the same file twice, as is intended\n", __func__);
+    } else kprintf("%s: ktfs opened the same file twice, as is intended\n", __func__);
     
     //opens up a different file to make sure that open/close is an independent event for different files 
+    uio_close(again);
     uio_close(uio);
 
     //kprintf("reached\n");
@@ -334,12 +359,16 @@ int test_ktfs_multiple_uio_reference(){
     open_file("c", "trek", &uioptr1); //this should work out, we've done this a thousand times by now
 
     retval = open_file("c", "trek", &uioptr2);
-    if (!(retval == -EBUSY)) {
+    if (retval < 0) {
         uio_close(uioptr1);
         return retval;
     }
+    unsigned long long pos = 0;
+    uio_read(uioptr1, buff1, 512);
+    uio_cntl(uioptr2, FCNTL_GETPOS, &pos);
     uio_close(uioptr1);
-    kprintf("this test supposedly works but I'm just a bit skeptical with not just opting to operate entirely with the refcnt \n");
+    uio_close(uioptr2);
+    if (pos != 0) return -EINVAL; //each open has its own position
     return 0;
 
 
@@ -448,5 +477,567 @@ int test_ktfs_setpos_past_end(){
     return 0;
 }
 
+//creates 40 files, deletes every other one (so most deletes move the last dentry into the hole) and
+//checks that every name still resolves to the right thing: the survivors open, the deleted ones are
+//-ENOENT, and their names can be created again. cleans up after itself
+int test_ktfs_name_index(){
+    char name[16];
+    struct uio * uio;
+    int retval;
+
+    for (int i = 0; i < 40; i++){
+        snprintf(name, sizeof(name), "nidx_%d", i);
+        retval = create_file("c", name);
+        if (retval < 0){
+            kprintf("%s: create %s failed: %s\n", __func__, name, error_name(retval));
+            return retval;
+        }
+    }
+    for (int i = 0; i < 40; i += 2){
+        snprintf(name, sizeof(name), "nidx_%d", i);
+        retval = delete_file("c", name);
+        if (retval < 0){
+            kprintf("%s: delete %s failed: %s\n", __func__, name, error_name(retval));
+            return retval;
+        }
+    }
+    for (int i = 0; i < 40; i++){
+        snprintf(name, sizeof(name), "nidx_%d", i);
+        retval = open_file("c", name, &uio);
+        if (retval == 0) uio_close(uio);
+        if ((i % 2 == 0) != (retval == -ENOENT)){
+            kprintf("%s: open %s gave %s\n", __func__, name, error_name(retval));
+            return -EINVAL;
+        }
+    }
+    if (delete_file("c", "nidx_0") != -ENOENT || create_file("c", "nidx_1") != -EEXIST){
+        kprintf("%s: a deleted name was found or a live one wasn't\n", __func__);
+        return -EINVAL;
+    }
+    for (int i = 0; i < 40; i++){
+        snprintf(name, sizeof(name), "nidx_%d", i);
+        if (i % 2 == 0 && create_file("c", name) < 0) return -EINVAL;
+        if (delete_file("c", name) < 0){
+            kprintf("%s: cleanup of %s failed\n", __func__, name);
+            return -EINVAL;
+        }
+    }
+    kprintf("%s: passed\n", __func__);
+    return 0;
+}
+
+//one of the writers of test_ktfs_concurrent_open, which runs in a thread of its own
+struct conc_writer {
+    struct uio * uio; // the writer's own open of the file
+    int first; // first block of buff1 it writes, at the same place in the file
+    int nblks;
+    unsigned long long end; // size it grows the file to with FCNTL_SETEND before writing, 0 to not
+    long retval; // 0, or the first error it got
+};
+
+//body of a writer thread of test_ktfs_concurrent_open. writes a block at a time and yields after each, so the other
+//writer and the readers get in between
+static void conc_writer_thread(struct conc_writer * cw){
+    unsigned long long pos = cw->first * 512;
+
+    if (cw->end != 0) cw->retval = uio_cntl(cw->uio, FCNTL_SETEND, &cw->end);
+    if (cw->retval == 0) cw->retval = uio_cntl(cw->uio, FCNTL_SETPOS, &pos);
+    for (int i = 0; i < cw->nblks && cw->retval == 0; i++){
+        if (uio_write(cw->uio, buff1 + (cw->first + i) * 512, 512) != 512) cw->retval = -EIO;
+        running_thread_yield();
+    }
+}
+
+//four opens of one file at once. two writer threads change it through their own opens: one appends blocks 2 and 3,
+//the other grows the file to 6 blocks with FCNTL_SETEND and fills blocks 4 and 5. meanwhile two readers go over the
+//first 2 blocks side by side, each at its own position. whichever order the stores land in, the file ends up as the
+//6 blocks of buff1, and the readers see the writers' blocks once they're done (the inode is shared). the file can't
+//be deleted until all four are closed
+int test_ktfs_concurrent_open(){
+    struct conc_writer wa = { .first = 2, .nblks = 2 };
+    struct conc_writer wb = { .first = 4, .nblks = 2, .end = 6 * 512 };
+    struct uio * opens[4]; // the writers' opens, then the readers'
+    unsigned long long end = 0;
+    int tida = -1, tidb = -1;
+    int nopen = 0;
+    long retval;
+
+    for (int i = 0; i < 6 * 512; i++) buff1[i] = i * 11 + 3;
+    retval = create_file("c", "conc");
+    while (retval == 0 && nopen < 4 && (retval = open_file("c", "conc", &opens[nopen])) == 0) nopen++;
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        while (nopen > 0) uio_close(opens[--nopen]);
+        delete_file("c", "conc");
+        return retval;
+    }
+    if (uio_write(opens[0], buff1, 2 * 512) != 2 * 512) retval = -EIO;
+
+    if (retval == 0){
+        wa.uio = opens[0];
+        wb.uio = opens[1];
+        tida = spawn_thread("concwa", (void (*)(void))conc_writer_thread, &wa);
+        tidb = spawn_thread("concwb", (void (*)(void))conc_writer_thread, &wb);
+        if (tida < 0 || tidb < 0) retval = -EMTHR;
+    }
+    //the first two blocks don't change while the writers work
+    for (int i = 0; i < 2 && retval == 0; i++){
+        if (uio_read(opens[2], buff2, 512) != 512 || memcmp(buff2, buff1 + i * 512, 512) != 0) retval = -EINVAL;
+        running_thread_yield();
+        if (uio_read(opens[3], buff3, 512) != 512 || memcmp(buff3, buff1 + i * 512, 512) != 0) retval = -EINVAL;
+        running_thread_yield();
+    }
+    if (tida >= 0) thread_join(tida);
+    if (tidb >= 0) thread_join(tidb);
+    if (retval == 0) retval = (wa.retval < 0) ? wa.retval : wb.retval;
+
+    if (retval == 0){
+        uio_cntl(opens[3], FCNTL_GETEND, &end);
+        if (end != 6 * 512 || uio_read(opens[2], buff2, 4 * 512) != 4 * 512 || memcmp(buff2, buff1 + 2 * 512, 4 * 512) != 0)
+            retval = -EINVAL;
+    }
+    if (retval == 0 && delete_file("c", "conc") != -EBUSY) retval = -EINVAL;
+    while (nopen > 0) uio_close(opens[--nopen]);
+    if (delete_file("c", "conc") < 0 && retval == 0) retval = -EINVAL;
+
+    if (retval < 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+    kprintf("%s: passed\n", __func__);
+    return 0;
+}
+
+//writes a file with a store big enough to skip the cache that starts partway into a block, overwrites its middle
+//(also unaligned at both ends) after reading the start of it into the cache, and checks that cached reads, a big
+//read and small reads with FCNTL_DIRECT all see the new data. deletes the file afterwards
+int test_ktfs_direct_io(){
+    const unsigned long head = 300;
+    const unsigned long size = head + KTFS_DIRECT_MIN * 4;
+    struct uio * uio;
+    unsigned long long pos = 700;
+    int direct = 1;
+    long retval;
+
+    for (unsigned long i = 0; i < size; i++) buff1[i] = i * 13 + 1;
+    retval = create_file("c", "dio");
+    if (retval == 0) retval = open_file("c", "dio", &uio);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+    if (uio_write(uio, buff1, head) != head || uio_write(uio, buff1 + head, size - head) != size - head) retval = -EIO;
+    uio_close(uio);
+
+    if (retval == 0) retval = open_file("c", "dio", &uio);
+    if (retval == 0){
+        if (uio_read(uio, buff2, 2048) != 2048) retval = -EIO;
+        for (unsigned long i = 0; i < KTFS_DIRECT_MIN * 2; i++) buff1[pos + i] = i * 5 + 77;
+        uio_cntl(uio, FCNTL_SETPOS, &pos);
+        if (uio_write(uio, buff1 + pos, KTFS_DIRECT_MIN * 2) != KTFS_DIRECT_MIN * 2) retval = -EIO;
+        pos = 0;
+        uio_cntl(uio, FCNTL_SETPOS, &pos);
+        if (uio_read(uio, buff2, 2048) != 2048 || memcmp(buff2, buff1, 2048) != 0) retval = -EINVAL;
+        uio_cntl(uio, FCNTL_SETPOS, &pos);
+        if (uio_read(uio, buff2, size) != size || memcmp(buff2, buff1, size) != 0) retval = -EINVAL;
+        uio_close(uio);
+    }
+    if (retval == 0) retval = open_file("c", "dio", &uio);
+    if (retval == 0){
+        uio_cntl(uio, FCNTL_DIRECT, &direct);
+        memset(buff2, 0, size);
+        for (unsigned long off = 0; off < size && retval == 0; off += 777){
+            long n = MIN(777, size - off);
+            if (uio_read(uio, buff2 + off, n) != n) retval = -EIO;
+        }
+        if (retval == 0 && memcmp(buff2, buff1, size) != 0) retval = -EINVAL;
+        uio_close(uio);
+    }
+    delete_file("c", "dio");
+
+    if (retval < 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+    kprintf("%s: passed\n", __func__);
+    return 0;
+}
+
+//grows a short file with FCNTL_SETEND into the doubly-indirect blocks, and checks that the new part reads as zeros.
+//then stores into the holes it left: unaligned across two blocks, a whole block, and an append to the partial last
+//block. a second open reads the file before the stores, so its copy of the block map still has them as holes, and
+//after, through the cache and with FCNTL_DIRECT. deletes the file afterwards
+int test_ktfs_sparse(){
+    const unsigned long head = 300;
+    const unsigned long end = HTEST_BLKS * 512 - 412;
+    const unsigned long tail = 50;
+    const unsigned long size = end + tail;
+    unsigned long long mid = 200 * 512 + 77;
+    unsigned long long whole = 10 * 512;
+    unsigned long long pos = end;
+    struct uio * w, * r;
+    int direct = 1;
+    long retval;
+
+    memset(buff1, 0, size);
+    for (unsigned long i = 0; i < head; i++) buff1[i] = i * 7 + 5;
+    retval = create_file("c", "sparse");
+    if (retval == 0) retval = open_file("c", "sparse", &w);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+    if (uio_write(w, buff1, head) != head) retval = -EIO;
+    if (retval == 0) retval = uio_cntl(w, FCNTL_SETEND, &pos);
+    pos = 0;
+    if (retval == 0) uio_cntl(w, FCNTL_GETEND, &pos);
+    if (retval == 0 && pos != end) retval = -EINVAL;
+
+    if (retval == 0 && open_file("c", "sparse", &r) == 0){
+        memset(buff2, 0xAA, size);
+        if (uio_read(r, buff2, size) != end || memcmp(buff2, buff1, end) != 0) retval = -EINVAL;
+
+        for (unsigned long i = 0; i < 600; i++) buff1[mid + i] = i * 3 + 1;
+        for (unsigned long i = 0; i < 512; i++) buff1[whole + i] = i * 9 + 2;
+        for (unsigned long i = 0; i < tail; i++) buff1[end + i] = i + 100;
+        uio_cntl(w, FCNTL_SETPOS, &mid);
+        if (retval == 0 && uio_write(w, buff1 + mid, 600) != 600) retval = -EIO;
+        uio_cntl(w, FCNTL_SETPOS, &whole);
+        if (retval == 0 && uio_write(w, buff1 + whole, 512) != 512) retval = -EIO;
+        pos = end;
+        uio_cntl(w, FCNTL_SETPOS, &pos);
+        if (retval == 0 && uio_write(w, buff1 + end, tail) != tail) retval = -EIO;
+
+        pos = 0;
+        uio_cntl(r, FCNTL_SETPOS, &pos);
+        memset(buff2, 0xAA, size);
+        if (retval == 0 && (uio_read(r, buff2, size) != size || memcmp(buff2, buff1, size) != 0)) retval = -EINVAL;
+        uio_cntl(r, FCNTL_SETPOS, &pos);
+        uio_cntl(r, FCNTL_DIRECT, &direct);
+        memset(buff2, 0xAA, size);
+        if (retval == 0 && (uio_read(r, buff2, size) != size || memcmp(buff2, buff1, size) != 0)) retval = -EINVAL;
+        uio_close(r);
+    } else if (retval == 0) retval = -EINVAL;
+    uio_close(w);
+    if (delete_file("c", "sparse") < 0 && retval == 0) retval = -EINVAL;
+
+    if (retval < 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+    kprintf("%s: passed\n", __func__);
+    return 0;
+}
 
+//times one ABENCH_BLKS block store into a new file. returns ticks, or a negative error code
+static long long bench_ktfs_alloc_store(const char * name){
+    unsigned long long t0, t1;
+    struct uio * uio;
+    long retval;
+
+    retval = create_file("c", name);
+    if (retval < 0) return retval;
+    retval = open_file("c", name, &uio);
+    if (retval < 0) return retval;
+    t0 = rdtime();
+    retval = uio_write(uio, buff3, ABENCH_BLKS * 512);
+    t1 = rdtime();
+    uio_close(uio);
+    if (retval != ABENCH_BLKS * 512) return (retval < 0) ? retval : -ENODATABLKS;
+    return t1 - t0;
+}
 
+//allocation throughput, on a nearly empty and a nearly full disk. fills the disk with ABENCH_FILE_BLKS block
+//files (a block at a time, so the last store fails cleanly), deletes the last one to leave a single hole at the
+//back, and times an append into it. an allocator that searches from block 0 every time pays for the whole
+//bitmap on each of those blocks. deletes everything it made
+int bench_ktfs_alloc(){
+    char name[16];
+    struct uio * uio;
+    long long t_empty, t_full;
+    int nfiles = 0;
+    int nfilled = 0;
+    int full = 0;
+
+    t_empty = bench_ktfs_alloc_store("abench_e");
+    delete_file("c", "abench_e");
+    if (t_empty < 0){
+        kprintf("%s: store on the empty disk failed: %s\n", __func__, error_name(t_empty));
+        return t_empty;
+    }
+
+    while (!full && nfiles < ABENCH_MAX_FILES){
+        snprintf(name, sizeof(name), "abench_%d", nfiles);
+        if (create_file("c", name) < 0) break; //out of inodes, which is as full as we can get
+        nfiles++;
+        if (open_file("c", name, &uio) < 0) break;
+        for (int i = 0; i < ABENCH_FILE_BLKS; i++){
+            if (uio_write(uio, buff3, 512) != 512){
+                full = 1;
+                break;
+            }
+            nfilled++;
+        }
+        uio_close(uio);
+    }
+
+    //the last file holds the blocks the failed store couldn't finish, the one before it a full ABENCH_FILE_BLKS
+    if (nfiles >= 2){
+        snprintf(name, sizeof(name), "abench_%d", nfiles - 2);
+        delete_file("c", name);
+    }
+    t_full = bench_ktfs_alloc_store("abench_f");
+    delete_file("c", "abench_f");
+
+    for (int i = 0; i < nfiles; i++){
+        snprintf(name, sizeof(name), "abench_%d", i);
+        delete_file("c", name);
+    }
+    if (t_full < 0){
+        kprintf("%s: store on the full disk failed: %s\n", __func__, error_name(t_full));
+        return t_full;
+    }
+
+    kprintf("%s: filled %d blocks in %d files\n", __func__, nfilled, nfiles);
+    kprintf("%s: ns per block appended | empty disk %llu | nearly full disk %llu\n", __func__,
+        t_empty * (1000000000UL / TIMER_FREQ) / ABENCH_BLKS,
+        t_full * (1000000000UL / TIMER_FREQ) / ABENCH_BLKS);
+    return 0;
+}
+
+//appends nblks blocks of buff3 to a file, creating it first if asked. returns 0 or a negative error code
+static int bench_ktfs_append(const char * name, int create, int nblks){
+    struct uio * uio;
+    unsigned long long end = 0;
+    long retval;
+
+    if (create && (retval = create_file("c", name)) < 0) return retval;
+    if ((retval = open_file("c", name, &uio)) < 0) return retval;
+    if ((retval = uio_cntl(uio, FCNTL_GETEND, &end)) == 0 && (retval = uio_cntl(uio, FCNTL_SETPOS, &end)) == 0)
+        retval = uio_write(uio, buff3, nblks * 512);
+    uio_close(uio);
+    return (retval == nblks * 512) ? 0 : (retval < 0) ? retval : -EIO;
+}
+
+//sequential read speed of a file that grew after its neighbour was deleted. the file starts with LBENCH_HEAD blocks,
+//a second file takes the next LBENCH_GROW, that one is deleted and a third file is written, and then the first file
+//grows by LBENCH_GROW. an allocator that aims for the block after the file's end puts the growth in the hole and the
+//file stays in one piece. one that takes the next free block from wherever it left off puts it after the third file.
+//the read skips the cache, so every break in the file is another device request. deletes everything it made
+int bench_ktfs_layout(){
+    struct uio * uio;
+    unsigned long long t0, t1;
+    int direct = 1;
+    long retval;
+
+    retval = bench_ktfs_append("lbench_a", 1, LBENCH_HEAD);
+    if (retval == 0) retval = bench_ktfs_append("lbench_b", 1, LBENCH_GROW);
+    if (retval == 0) retval = delete_file("c", "lbench_b");
+    if (retval == 0) retval = bench_ktfs_append("lbench_c", 1, LBENCH_HEAD);
+    if (retval == 0) retval = bench_ktfs_append("lbench_a", 0, LBENCH_GROW);
+    if (retval == 0) retval = open_file("c", "lbench_a", &uio);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        delete_file("c", "lbench_a");
+        delete_file("c", "lbench_c");
+        return retval;
+    }
+
+    uio_cntl(uio, FCNTL_DIRECT, &direct);
+    t0 = rdtime();
+    retval = uio_read(uio, buff2, (LBENCH_HEAD + LBENCH_GROW) * 512);
+    t1 = rdtime();
+    uio_close(uio);
+    delete_file("c", "lbench_a");
+    delete_file("c", "lbench_c");
+
+    if (retval != (LBENCH_HEAD + LBENCH_GROW) * 512 || memcmp(buff2, buff3, LBENCH_HEAD * 512) != 0){
+        kprintf("%s: read back %ld bytes, or the wrong ones\n", __func__, retval);
+        return -EIO;
+    }
+    kprintf("%s: ns per block read from a file grown into a hole: %llu\n", __func__,
+        (t1 - t0) * (1000000000UL / TIMER_FREQ) / (LBENCH_HEAD + LBENCH_GROW));
+    return 0;
+}
+
+//the mounted cache's counters, through dev/cachestat0. returns 0 or a negative error code
+static int bench_ktfs_cache_stats(struct cache_stats * stats){
+    struct serial * statdev = find_serial("cachestat", 0);
+    int retval;
+
+    if (statdev == NULL) return -ENOENT;
+    if ((retval = serial_open(statdev)) < 0) return retval;
+    retval = serial_recv(statdev, stats, sizeof(*stats));
+    serial_close(statdev);
+    return (retval == sizeof(*stats)) ? 0 : -EIO;
+}
+
+//cache gets per block for a sequential read of a MBENCH_BLKS block file, a block per read. each read gets its data
+//block, and whatever lookups it takes to find it: one or two index blocks per data block if every lookup walks the
+//index, one per 128 if the open file keeps a copy of the index block it's in. deletes the file afterwards
+int bench_ktfs_blockmap(){
+    struct cache_stats before, after;
+    unsigned long long t0, t1;
+    struct uio * uio;
+    long retval = 0;
+
+    for (int i = 0; i < MBENCH_BLKS && retval == 0; i += 128) retval = bench_ktfs_append("mbench", i == 0, 128);
+    if (retval == 0) retval = open_file("c", "mbench", &uio);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        delete_file("c", "mbench");
+        return retval;
+    }
+
+    retval = bench_ktfs_cache_stats(&before);
+    t0 = rdtime();
+    for (int i = 0; i < MBENCH_BLKS && retval == 0; i++){
+        if (uio_read(uio, buff2, 512) != 512 || memcmp(buff2, buff3 + i % 128 * 512, 512) != 0) retval = -EIO;
+    }
+    t1 = rdtime();
+    if (retval == 0) retval = bench_ktfs_cache_stats(&after);
+    uio_close(uio);
+    delete_file("c", "mbench");
+    if (retval < 0){
+        kprintf("%s: read failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    kprintf("%s: %d blocks | cache gets per 100 blocks %llu | ns per block %llu\n", __func__, MBENCH_BLKS,
+        (after.hits + after.misses - before.hits - before.misses) * 100 / MBENCH_BLKS,
+        (t1 - t0) * (1000000000UL / TIMER_FREQ) / MBENCH_BLKS);
+    return 0;
+}
+
+//appends SBENCH_RECS records of SBENCH_RECSZ bytes to a new file through one open, then reads it back. prints the cache
+//gets each append took: the data block it lands in, plus the inode block if every append writes the inode back rather
+//than leaving it to close. deletes the file afterwards
+int bench_ktfs_small_append(){
+    struct cache_stats before, after;
+    struct uio * uio;
+    long retval;
+
+    retval = create_file("c", "sbench");
+    if (retval == 0) retval = open_file("c", "sbench", &uio);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    retval = bench_ktfs_cache_stats(&before);
+    for (int i = 0; i < SBENCH_RECS && retval == 0; i++){
+        if (uio_write(uio, buff3 + i * SBENCH_RECSZ, SBENCH_RECSZ) != SBENCH_RECSZ) retval = -EIO;
+    }
+    if (retval == 0) retval = bench_ktfs_cache_stats(&after);
+    uio_close(uio);
+
+    if (retval == 0) retval = open_file("c", "sbench", &uio);
+    if (retval == 0){
+        if (uio_read(uio, buff2, SBENCH_RECS * SBENCH_RECSZ) != SBENCH_RECS * SBENCH_RECSZ
+            || memcmp(buff2, buff3, SBENCH_RECS * SBENCH_RECSZ) != 0) retval = -EIO;
+        uio_close(uio);
+    }
+    delete_file("c", "sbench");
+    if (retval < 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    kprintf("%s: %d appends of %d bytes | cache gets per 100 appends %llu\n", __func__, SBENCH_RECS, SBENCH_RECSZ,
+        (after.hits + after.misses - before.hits - before.misses) * 100 / SBENCH_RECS);
+    return 0;
+}
+
+//creates FBENCH_FILES files (fewer if the inodes run out), then times an open and close of each, which has no file
+//record to start from and so reads the dentry and the inode, and a listing of the whole directory. prints the pages
+//the creates took, which is the name index growing. deletes the files afterwards
+int bench_ktfs_many_files(){
+    unsigned long long t0, t1, t2;
+    unsigned long pages0, pages1;
+    char name[16];
+    struct uio * uio;
+    long nread;
+    int retval = 0;
+    int nfiles, nnames = 0;
+
+    pages0 = free_phys_page_count();
+    for (nfiles = 0; nfiles < FBENCH_FILES; nfiles++){
+        snprintf(name, sizeof(name), "fbench_%d", nfiles);
+        if (create_file("c", name) < 0) break; //out of inodes
+    }
+    pages1 = free_phys_page_count();
+
+    t0 = rdtime();
+    for (int i = 0; i < nfiles && retval == 0; i++){
+        snprintf(name, sizeof(name), "fbench_%d", i);
+        retval = open_file("c", name, &uio);
+        if (retval == 0) uio_close(uio);
+    }
+    t1 = rdtime();
+    if (retval == 0) retval = open_file("c", "", &uio);
+    if (retval == 0){
+        while ((nread = uio_read(uio, buff2, 4096)) > 0){
+            for (long j = 0; j < nread; j++) nnames += (buff2[j] == '\r');
+        }
+        uio_close(uio);
+    }
+    t2 = rdtime();
+
+    for (int i = 0; i < nfiles; i++){
+        snprintf(name, sizeof(name), "fbench_%d", i);
+        delete_file("c", name);
+    }
+    if (retval < 0 || nfiles == 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    kprintf("%s: %d files, %d names listed | pages taken by the creates %lu\n", __func__, nfiles, nnames, pages0 - pages1);
+    kprintf("%s: ns per open and close %llu | ns per name listed %llu\n", __func__,
+        (t1 - t0) * (1000000000UL / TIMER_FREQ) / nfiles,
+        (t2 - t1) * (1000000000UL / TIMER_FREQ) / (nnames ? nnames : 1));
+    return 0;
+}
+
+//grows an empty file to HBENCH_BLKS blocks with one FCNTL_SETEND, and prints the cache gets and time it took. writing
+//the new part out would be a get per block; leaving it a hole is a few, however far it grows. then stores a block at
+//the end and reads it back, and reads one from the middle, which has to be zeros. deletes the file afterwards
+int bench_ktfs_setend(){
+    struct cache_stats before, after;
+    unsigned long long t0, t1;
+    unsigned long long pos = (unsigned long long)HBENCH_BLKS * 512;
+    struct uio * uio;
+    long retval;
+
+    retval = create_file("c", "hbench");
+    if (retval == 0) retval = open_file("c", "hbench", &uio);
+    if (retval < 0){
+        kprintf("%s: setup failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    retval = bench_ktfs_cache_stats(&before);
+    t0 = rdtime();
+    if (retval == 0) retval = uio_cntl(uio, FCNTL_SETEND, &pos);
+    t1 = rdtime();
+    if (retval == 0) retval = bench_ktfs_cache_stats(&after);
+
+    uio_cntl(uio, FCNTL_SETPOS, &pos);
+    if (retval == 0 && uio_write(uio, buff3, 512) != 512) retval = -EIO;
+    uio_cntl(uio, FCNTL_SETPOS, &pos);
+    if (retval == 0 && (uio_read(uio, buff2, 1024) != 512 || memcmp(buff2, buff3, 512) != 0)) retval = -EIO;
+    pos /= 2;
+    uio_cntl(uio, FCNTL_SETPOS, &pos);
+    if (retval == 0 && uio_read(uio, buff2, 512) != 512) retval = -EIO;
+    for (int i = 0; i < 512 && retval == 0; i++) if (buff2[i] != 0) retval = -EINVAL;
+    uio_close(uio);
+    delete_file("c", "hbench");
+    if (retval < 0){
+        kprintf("%s: failed: %s\n", __func__, error_name(retval));
+        return retval;
+    }
+
+    kprintf("%s: SETEND to %d blocks | cache gets %llu | ns %llu\n", __func__, HBENCH_BLKS,
+        after.hits + after.misses - before.hits - before.misses, (t1 - t0) * (1000000000UL / TIMER_FREQ));
+    return 0;
+}
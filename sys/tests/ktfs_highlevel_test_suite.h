@@ -20,5 +20,15 @@ int test_ktfs_open_many(void);
 int test_ktfs_multi_create(void);
 int test_ktfs_delete_free_actual(void);
 int test_ktfs_store_precision(void);
+int test_ktfs_name_index(void); //opens, creates and deletes by name after deletes have moved dentries around
+int test_ktfs_concurrent_open(void); //two writer threads and two readers on one file at once, each through its own open
+int test_ktfs_direct_io(void); //unaligned stores and reads big enough to skip the cache, checked against cached reads
+int test_ktfs_sparse(void); //SETEND leaves holes that read as zeros, and stores into them land where they should
+int bench_ktfs_alloc(void); //append throughput on a nearly empty and a nearly full disk
+int bench_ktfs_layout(void); //read speed of a file that grew into the hole a deleted file left
+int bench_ktfs_blockmap(void); //cache gets per block for a sequential read deep into the doubly-indirect blocks
+int bench_ktfs_small_append(void); //cache gets per small append to one open file
+int bench_ktfs_many_files(void); //open and listing cost with thousands of files, and the memory their name index takes
+int bench_ktfs_setend(void); //cache gets for a SETEND that grows a file by thousands of blocks
 #endif // _VIOBLKTESTSUITE_1_H_
 
@@ -62,8 +62,9 @@ void main(void) {
     console_init();
     intrmgr_init();
     devmgr_init();
+    memory_init(); // block caches take their arenas from the page allocator
     thrmgr_init();
-    heap_init(_kimg_end, RAM_END);
+    // heap_init(_kimg_end, RAM_END);
 
     attach_devices();
 
@@ -139,7 +140,7 @@ void mount_cdrive(void) {
         halt_failure();
     }
 
-    result = create_cache(hd, &cache);
+    result = create_cache(hd, 0, &cache);
 
     if (result != 0) {
         kprintf("create_cache(%s%d) failed: %s\n",
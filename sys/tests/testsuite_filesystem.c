@@ -61,7 +61,7 @@ int test_mount_ktfs(va_list ap) {
         // halt_failure();
     }
 
-    result = create_cache(hd, &cache);
+    result = create_cache(hd, 0, &cache);
 
     if (result != 0) {
         kprintf("create_cache(%s%d) failed: %s\n",
@@ -37,6 +37,7 @@
 #include "console.h"
 #include <stdarg.h>
 #include "process.h"
+#include "filesys.h"
 
 // COMPILE-TIME PARAMETERS
 //
@@ -323,6 +324,7 @@ int spawn_thread (
 void running_thread_exit(void) {
     if (TP->id == MAIN_TID)
     {
+        fsmgr_flushall();                               // block caches only write back on eviction, so push out what's left
         halt_success();                                 
     }
     else
@@ -330,7 +332,8 @@ void running_thread_exit(void) {
         TP->state = THREAD_EXITED;
     }
     release_all_thread_locks(TP); /// forgot to add this LOL
-    condition_broadcast(&TP->parent->child_exit);           // broadcast to parent
+    if (TP->parent != NULL)                                 // a detached thread has nobody to tell, create_thread reclaims it
+        condition_broadcast(&TP->parent->child_exit);       // broadcast to parent
     running_thread_suspend();                               // suspends exiting thread permanently. Should not reach halt_failure() 
 
     halt_failure();
@@ -601,12 +604,16 @@ struct thread * create_thread(const char * name) {
 
     trace("%s(name=\"%s\") in <%s:%d>", __func__, name, TP->name, TP->id);
 
-    // Find a free thread slot.
+    // Find a free thread slot. Nobody joins a detached thread (see thread_detach),
+    // so one that has exited gives its slot up here.
 
     tid = 0;
-    while (++tid < NTHR)
+    while (++tid < NTHR) {
+        if (thrtab[tid] != NULL && thrtab[tid]->parent == NULL && thrtab[tid]->state == THREAD_EXITED)
+            thread_reclaim(tid);
         if (thrtab[tid] == NULL)
             break;
+    }
     
     if (tid == NTHR)
         return NULL;
@@ -114,7 +114,8 @@ extern struct process * running_thread_process(void);
 extern void thread_set_process(int tid, struct process * proc);
 
 // Sets the parent of thread /tid/ to NULL. The parent will not longer be able
-// to wait for the specified thread to exit.
+// to wait for the specified thread to exit. Once it exits, its slot is
+// reclaimed by the next spawn_thread.
 
 extern void thread_detach(int tid);
 
@@ -200,6 +200,31 @@ void alarm_reset(struct alarm * al) {
     al->twake = rdtime();
 }
 
+// Wakes the thread sleeping on the alarm right away instead of at its wake-up
+// time. Does nothing if nobody is sleeping on the alarm.
+
+void alarm_wake(struct alarm * al) {
+    struct alarm ** link;
+    int pie;
+
+    pie = disable_interrupts();
+    link = &sleep_list;
+    while (*link != NULL && *link != al)
+        link = &(*link)->next;
+
+    if (*link == al) {
+        *link = al->next;
+        al->next = NULL;
+        condition_broadcast(&(al->cond));
+
+        if (sleep_list == NULL)
+            csrc_sie(RISCV_SIE_STIE);
+        else
+            set_stcmp(sleep_list->twake);
+    }
+    restore_interrupts(pie);
+}
+
 void alarm_sleep_sec(struct alarm * al, unsigned int sec) {
     alarm_sleep(al, sec * TIMER_FREQ);
 }
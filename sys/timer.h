@@ -41,6 +41,11 @@ extern void alarm_preempt(void);
 
 extern void alarm_reset(struct alarm * al);
 
+// Wakes the thread sleeping on the alarm now rather than at its wake-up time.
+// Does nothing if the alarm isn't pending.
+
+extern void alarm_wake(struct alarm * al);
+
 extern void alarm_sleep_sec(struct alarm * al, unsigned int sec);
 extern void alarm_sleep_ms(struct alarm * al, unsigned long ms);
 extern void alarm_sleep_us(struct alarm * al, unsigned long us);
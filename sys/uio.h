@@ -96,6 +96,8 @@ extern void create_pipe(struct uio **wptr, struct uio **rptr);
 #define FCNTL_SETPOS 3  // arg is unsigned long long *
 
 #define FCNTL_MMAP 4  // arg is void **
+#define FCNTL_DIRECT 5  // arg is int *: 1 to read and write past the cache, 0 to go back to cached I/O
+#define FCNTL_RESET 6  // arg is unused: zeroes the counters of a stats device (dev/cachestat)
 
 // See also device.h for device-specific fcntl values
 
@@ -82,6 +82,8 @@ struct uioterm {
 #define FCNTL_SETPOS 3 // arg is unsigned long long *
 
 #define FCNTL_MMAP   4 // arg is void **
+#define FCNTL_DIRECT 5 // arg is int *: 1 to read and write past the cache, 0 to go back to cached I/O
+#define FCNTL_RESET  6 // arg is unused: zeroes the counters of a stats device (dev/cachestat)
 
 // refcount functions
 /**
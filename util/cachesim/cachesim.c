@@ -0,0 +1,288 @@
+/*! @file cachesim.c
+    @brief Replays a cache access trace recorded by the kernel (see CACHE_RECORD_MAX in conf.h)
+    against sys/cache.c built for the host, at several capacities, line sizes and replacement
+    policies, and prints what each would have cost. Getting a trace:
+
+        1. build the kernel with CACHE_RECORD_MAX set (65536 records is 512 KB per cache)
+        2. run the workload, then "cat dev/cachetrace0 > c/trace" from the shell
+        3. pull the file off the image with util/unmkfs_ktfs
+
+    Usage: cachesim [-f N] TRACE [CAPACITY...]
+
+    CAPACITY is in CACHE_BLKSZ blocks (default 64 128 256 512 1024). -f N flushes the cache every N
+    records (at the next point where the trace holds no blocks), standing in for the background
+    flusher, which the host build doesn't have. Without it every write-back before the final flush
+    happens on eviction.
+    @copyright Copyright (c) 2024-2025 University of Illinois
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "devimpl.h"
+#include "memory.h"
+
+#define SIM_MAX_HOLDS 4096  // blocks the trace can hold at once
+
+// INTERNAL TYPE DEFINITIONS
+//
+
+/// @brief memory-backed storage device the replayed cache sits on
+struct memdisk {
+    struct storage base;  // must be first
+    unsigned char* data;
+};
+
+/// @brief a block the trace has gotten and not yet released
+struct sim_hold {
+    unsigned long long pos;
+    void* blk;
+    int flags;  // flags it was gotten with
+};
+
+/// @brief what one replay came to
+struct sim_result {
+    struct cache_stats stats;
+    unsigned long failed;   // gets the replayed cache couldn't serve (every slot pinned)
+    unsigned long orphans;  // releases of blocks gotten before the trace started
+    unsigned long long us;  // host time the replay took
+};
+
+// INTERNAL FUNCTION DECLARATIONS
+//
+
+static long memdisk_fetch(struct storage* sto, unsigned long long pos, void* buf,
+                          unsigned long bytecnt);
+static long memdisk_store(struct storage* sto, unsigned long long pos, const void* buf,
+                          unsigned long bytecnt);
+static void sim_get(struct cache* cache, unsigned long long pos, int flags, struct sim_result* res);
+static void sim_release(struct cache* cache, unsigned long long pos, int dirty, struct sim_result* res);
+static void sim_flush(struct cache* cache);
+static int sim_replay(struct storage* sto, const unsigned long long* recs, size_t nrecs,
+                      unsigned int capacity, int mode, int policy, unsigned long flush_every,
+                      struct sim_result* res);
+
+// INTERNAL GLOBAL VARIABLES AND CONSTANTS
+//
+
+static const struct storage_intf memdisk_intf = {
+    .blksz = CACHE_BLKSZ, .fetch = &memdisk_fetch, .store = &memdisk_store};
+
+static struct sim_hold holds[SIM_MAX_HOLDS];
+static int nholds;
+
+int main(int argc, char** argv) {
+    static const unsigned int default_caps[] = {64, 128, 256, 512, 1024};
+    static const char* const mode_names[] = {"block", "page"};
+    static const char* const policy_names[] = {"2q", "lru"};
+    unsigned long flush_every = 0;
+    unsigned long long* recs;
+    unsigned long long max_pos = 0;
+    struct memdisk disk;
+    struct sim_result res;
+    size_t nrecs;
+    long size;
+    FILE* f;
+    int argi = 1;
+
+    if (argi + 1 < argc && strcmp(argv[argi], "-f") == 0) {
+        flush_every = strtoul(argv[argi + 1], NULL, 10);
+        argi += 2;
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "usage: %s [-f N] TRACE [CAPACITY...]\n", argv[0]);
+        return 2;
+    }
+
+    // The trace is read as is. The kernel is little endian, as is any host this is likely run on.
+
+    f = fopen(argv[argi], "rb");
+    if (f == NULL) {
+        perror(argv[argi]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    nrecs = size / sizeof(unsigned long long);
+    recs = malloc(nrecs * sizeof(unsigned long long) + 1);
+    if (recs == NULL || fread(recs, sizeof(unsigned long long), nrecs, f) != nrecs) {
+        fprintf(stderr, "%s: can't read the trace\n", argv[argi]);
+        return 1;
+    }
+    fclose(f);
+    argi++;
+
+    for (size_t i = 0; i < nrecs; i++)
+        if (CACHE_REC_POS(recs[i]) > max_pos) max_pos = CACHE_REC_POS(recs[i]);
+
+    // The disk only has to cover the positions in the trace (plus read-ahead past the last one);
+    // what's on it doesn't matter
+
+    disk.data = calloc(1, max_pos + (CACHE_IO_MAX + 1) * PAGE_SIZE);
+    if (disk.data == NULL) {
+        fprintf(stderr, "no memory for a %llu byte disk\n", max_pos);
+        return 1;
+    }
+    storage_init(&disk.base, &memdisk_intf, max_pos + (CACHE_IO_MAX + 1) * PAGE_SIZE);
+
+    printf("%zu records, highest block %llu\n", nrecs, max_pos / CACHE_BLKSZ);
+    printf("%8s %6s %6s %10s %10s %7s %10s %10s %10s %8s %8s\n", "capacity", "lines", "policy",
+           "hits", "misses", "hit%", "evictions", "writebacks", "sync", "ra-waste", "us");
+
+    for (int c = 0; c < ((argi < argc) ? argc - argi : 5); c++) {
+        unsigned int capacity = (argi < argc) ? strtoul(argv[argi + c], NULL, 10) : default_caps[c];
+
+        for (int mode = CACHE_MODE_BLOCK; mode <= CACHE_MODE_PAGE; mode++) {
+            for (int policy = CACHE_POLICY_2Q; policy <= CACHE_POLICY_LRU; policy++) {
+                unsigned long long refs;
+
+                if (sim_replay(&disk.base, recs, nrecs, capacity, mode, policy, flush_every, &res) < 0) {
+                    fprintf(stderr, "no cache of %u blocks\n", capacity);
+                    return 1;
+                }
+                refs = res.stats.hits + res.stats.misses;
+                printf("%8u %6s %6s %10llu %10llu %6.2f%% %10llu %10llu %10llu %8llu %8llu", capacity,
+                       mode_names[mode], policy_names[policy], res.stats.hits, res.stats.misses,
+                       refs ? 100.0 * res.stats.hits / refs : 0.0, res.stats.evictions,
+                       res.stats.writebacks, res.stats.sync_stores, res.stats.prefetch_wasted, res.us);
+                if (res.failed || res.orphans) printf("  (%lu failed, %lu orphans)", res.failed, res.orphans);
+                printf("\n");
+            }
+        }
+    }
+    return 0;
+}
+
+// INTERNAL FUNCTION DEFINITIONS
+//
+
+static long memdisk_fetch(struct storage* sto, unsigned long long pos, void* buf,
+                          unsigned long bytecnt) {
+    struct memdisk* const disk = (struct memdisk*)sto;
+
+    if (pos >= sto->capacity) return 0;
+    if (bytecnt > sto->capacity - pos) bytecnt = sto->capacity - pos;
+    memcpy(buf, disk->data + pos, bytecnt);
+    return bytecnt;
+}
+
+static long memdisk_store(struct storage* sto, unsigned long long pos, const void* buf,
+                          unsigned long bytecnt) {
+    struct memdisk* const disk = (struct memdisk*)sto;
+
+    if (pos >= sto->capacity) return 0;
+    if (bytecnt > sto->capacity - pos) bytecnt = sto->capacity - pos;
+    memcpy(disk->data + pos, buf, bytecnt);
+    return bytecnt;
+}
+
+/**
+ * @brief replays a get. the kernel records a get once it's been granted, so a get that conflicts
+ * with a hold the replay still has can only come from a trace that's cut short. shared holds on
+ * the line go first in that case, as their threads' releases would have in the kernel
+ * @param cache the replayed cache
+ * @param pos block position
+ * @param flags flags the block was gotten with
+ * @param res counts the failed gets
+ */
+static void sim_get(struct cache* cache, unsigned long long pos, int flags, struct sim_result* res) {
+    void* blk;
+
+    if (!(flags & CACHE_SHARED)) {
+        for (int i = nholds - 1; i >= 0; i--) {
+            if ((holds[i].flags & CACHE_SHARED) && holds[i].pos / PAGE_SIZE == pos / PAGE_SIZE) {
+                cache_release_block(cache, holds[i].blk, 0);
+                holds[i] = holds[--nholds];
+            }
+        }
+    }
+    if (nholds == SIM_MAX_HOLDS || cache_get_block_flags(cache, pos, flags, &blk) < 0) {
+        res->failed++;
+        return;
+    }
+    holds[nholds].pos = pos;
+    holds[nholds].blk = blk;
+    holds[nholds].flags = flags;
+    nholds++;
+}
+
+/**
+ * @brief replays a release, of the latest hold on pos
+ * @param cache the replayed cache
+ * @param pos block position
+ * @param dirty whether the block was released dirty
+ * @param res counts the releases that match no hold
+ */
+static void sim_release(struct cache* cache, unsigned long long pos, int dirty, struct sim_result* res) {
+    for (int i = nholds - 1; i >= 0; i--) {
+        if (holds[i].pos == pos) {
+            cache_release_block(cache, holds[i].blk, dirty && !(holds[i].flags & CACHE_SHARED));
+            holds[i] = holds[--nholds];
+            return;
+        }
+    }
+    res->orphans++;
+}
+
+/**
+ * @brief flushes the cache as its flusher thread would. the flusher waits for holds, which a
+ * single thread can't, so the replay must hold no blocks
+ * @param cache the replayed cache
+ */
+static void sim_flush(struct cache* cache) {
+    host_tid = HOST_FLUSHER_TID;
+    cache_flush(cache);
+    host_tid = HOST_TID;
+}
+
+/**
+ * @brief replays a whole trace against a fresh cache
+ * @param sto device for the cache
+ * @param recs the trace
+ * @param nrecs records in the trace
+ * @param capacity cache size in CACHE_BLKSZ blocks
+ * @param mode CACHE_MODE_BLOCK or CACHE_MODE_PAGE
+ * @param policy CACHE_POLICY_2Q or CACHE_POLICY_LRU
+ * @param flush_every records between flushes, 0 for none
+ * @param res filled in with the outcome
+ * @return 0 on success, negative error code if the cache couldn't be created
+ */
+static int sim_replay(struct storage* sto, const unsigned long long* recs, size_t nrecs,
+                      unsigned int capacity, int mode, int policy, unsigned long flush_every,
+                      struct sim_result* res) {
+    struct cache* cache;
+    struct timespec t0, t1;
+    unsigned long since_flush = 0;
+    int result;
+
+    result = create_cache_mode(sto, capacity, mode, &cache);
+    if (result < 0) return result;
+    cache_set_policy(cache, policy);
+    memset(res, 0, sizeof(*res));
+    nholds = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < nrecs; i++) {
+        unsigned long long pos = CACHE_REC_POS(recs[i]);
+
+        if (recs[i] & CACHE_REC_RELEASE)
+            sim_release(cache, pos, (recs[i] & CACHE_REC_DIRTY) != 0, res);
+        else
+            sim_get(cache, pos, (recs[i] & (CACHE_BLKSZ - 1)) >> CACHE_REC_FLAGS_SHIFT, res);
+        if (flush_every && ++since_flush >= flush_every && nholds == 0) {
+            sim_flush(cache);
+            since_flush = 0;
+        }
+    }
+    while (nholds > 0) cache_release_block(cache, holds[--nholds].blk, 0);
+    sim_flush(cache);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    cache_get_stats(cache, &res->stats);
+    res->us = (t1.tv_sec - t0.tv_sec) * 1000000ULL + (t1.tv_nsec - t0.tv_nsec) / 1000;
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*! @file hostshim.h
+    @brief Forced into every file of a host build of the cache (see Makefile). Stands in for the
+    parts of the kernel headers that only make sense on RISC-V.
+    @copyright Copyright (c) 2024-2025 University of Illinois
+
+*/
+
+#ifndef _HOSTSHIM_H_
+#define _HOSTSHIM_H_
+
+#define _RISCV_H_  // keeps riscv.h, which is all CSR access and inline asm, out of the build
+
+#include <time.h>
+
+#include "conf.h"
+
+#define HOST_TID 1          // the thread the replay runs as
+#define HOST_FLUSHER_TID 2  // what spawn_thread() hands the cache for its flusher
+
+// thread running_thread() reports. cachesim switches it to HOST_FLUSHER_TID for the flushes that
+// stand in for the flusher thread, so they don't count as sync_stores
+extern int host_tid;
+
+/**
+ * @brief Host replacement for the rdtime() of riscv.h, in the same TIMER_FREQ ticks
+ * @return ticks of a monotonic clock
+ */
+static inline unsigned long long rdtime(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * TIMER_FREQ + ts.tv_nsec / (1000000000UL / TIMER_FREQ);
+}
+
+#endif  // _HOSTSHIM_H_
@@ -0,0 +1,107 @@
+/*! @file hoststubs.c
+    @brief The kernel services sys/cache.c uses, for a single-threaded host build. Locks and
+    conditions only check that the replay never has to wait, there is no flusher thread (write-backs
+    happen on eviction or when cachesim flushes in its place), and the page allocator and heap are
+    malloc.
+    @copyright Copyright (c) 2024-2025 University of Illinois
+
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "devimpl.h"
+#include "heap.h"
+#include "memory.h"
+#include "misc.h"
+#include "thread.h"
+#include "timer.h"
+
+// THREADS AND LOCKS
+//
+
+int host_tid = HOST_TID;
+
+int running_thread(void) { return host_tid; }
+
+int spawn_thread(const char* name, void (*start)(void), ...) { return HOST_FLUSHER_TID; }
+
+void thread_detach(int tid) {}
+
+void lock_init(struct lock* lock) { memset(lock, 0, sizeof(*lock)); }
+
+void lock_acquire(struct lock* lock) {
+    if (lock->cnt > 0 && lock->owner != (struct thread*)(long)host_tid) panic("lock held by another thread");
+    lock->owner = (struct thread*)(long)host_tid;
+    lock->cnt++;
+}
+
+void lock_release(struct lock* lock) {
+    assert(lock->cnt > 0);
+    if (--lock->cnt == 0) lock->owner = NULL;
+}
+
+void condition_init(struct condition* cond, const char* name) { memset(cond, 0, sizeof(*cond)); }
+
+void condition_wait(struct condition* cond) { panic("replay would block, nobody else can wake it"); }
+
+void condition_broadcast(struct condition* cond) {}
+
+void alarm_init(struct alarm* al, const char* name) { memset(al, 0, sizeof(*al)); }
+
+void alarm_reset(struct alarm* al) {}
+
+void alarm_sleep(struct alarm* al, unsigned long long tcnt) { panic("no flusher thread on the host"); }
+
+void alarm_sleep_ms(struct alarm* al, unsigned long ms) { panic("no flusher thread on the host"); }
+
+void alarm_wake(struct alarm* al) {}
+
+// MEMORY
+//
+
+void* alloc_phys_pages(unsigned int cnt) {
+    void* pp;
+
+    return (posix_memalign(&pp, PAGE_SIZE, (size_t)cnt * PAGE_SIZE) == 0) ? pp : NULL;
+}
+
+void free_phys_pages(void* pp, unsigned int cnt) { free(pp); }
+
+void* kmalloc(size_t size) { return malloc(size); }
+
+void* kcalloc(size_t nelts, size_t eltsz) { return calloc(nelts, eltsz); }
+
+void kfree(void* ptr) { free(ptr); }
+
+// DEVICES AND CONSOLE
+//
+
+int register_device(const char* name, enum device_type type, void* device_struct) { return 0; }
+
+int unregister_device(void* device_struct) { return 0; }
+
+long storage_fetch(struct storage* sto, unsigned long long pos, void* buf, unsigned long bytecnt) {
+    return sto->intf->fetch(sto, pos, buf, bytecnt);
+}
+
+long storage_store(struct storage* sto, unsigned long long pos, const void* buf,
+                   unsigned long bytecnt) {
+    return sto->intf->store(sto, pos, buf, bytecnt);
+}
+
+void __attribute__((noreturn)) panic_actual(const char* filename, int lineno, const char* msg) {
+    fprintf(stderr, "panic at %s:%d: %s\n", filename, lineno, msg);
+    abort();
+}
+
+void __attribute__((noreturn)) assert_failed(const char* filename, int lineno, const char* stmt) {
+    fprintf(stderr, "assertion failed at %s:%d: %s\n", filename, lineno, stmt);
+    abort();
+}
+
+void debug_actual(const char* filename, int lineno, const char* fmt, ...) {}
+
+void trace_actual(const char* filename, int lineno, const char* fmt, ...) {}
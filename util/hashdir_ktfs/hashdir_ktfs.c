@@ -0,0 +1,266 @@
+/*! @file hashdir_ktfs.c
+    @brief Gives a KTFS image made by mkfs_ktfs a hashed root directory (KTFS_FEATURE_HASHDIR, see
+    sys/ktfs.h), so the kernel finds a name by reading one directory block rather than scanning
+    them all at mount. The files and their data stay where they are; only the root directory's
+    blocks are replaced.
+
+        ./mkfs_ktfs ../sys/ktfs.raw 8M 4096 FILE...
+        hashdir_ktfs/hashdir_ktfs ../sys/ktfs.raw
+
+    Usage: hashdir_ktfs [-b BUCKETS] IMAGE
+
+    BUCKETS is the number of directory blocks, a power of two. The default is the smallest that
+    keeps the directory at most half full with a file for every inode, since it never grows.
+    @copyright Copyright (c) 2024-2025 University of Illinois
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ktfs.h"
+
+#define PTRS_PER_BLK (KTFS_BLKSZ / sizeof(uint32_t))
+
+// INTERNAL TYPE DEFINITIONS
+//
+
+/// @brief an image read into memory, and where its sections start (in blocks)
+struct image {
+    unsigned char* data;
+    long size;
+    struct ktfs_superblock* sb;
+    uint32_t bitmap_start;
+    uint32_t inode_start;
+    uint32_t data_start;
+    uint32_t ndata;  // data blocks
+};
+
+// INTERNAL FUNCTION DECLARATIONS
+//
+
+static void* block(struct image* img, uint32_t db);
+static uint32_t* file_block(struct image* img, struct ktfs_inode* inode, uint32_t idx);
+static void free_db(struct image* img, uint32_t db);
+static int claim_run(struct image* img, uint32_t n, uint32_t* first);
+static void free_file_blocks(struct image* img, struct ktfs_inode* inode);
+static int alloc_dir(struct image* img, struct ktfs_inode* inode, uint32_t nbuckets);
+
+int main(int argc, char** argv) {
+    struct ktfs_dir_entry* dents;
+    struct ktfs_inode* root;
+    struct image img;
+    uint32_t nbuckets = 0;
+    uint32_t nfiles, max_inodes;
+    int argi = 1;
+    FILE* f;
+
+    if (argi + 1 < argc && strcmp(argv[argi], "-b") == 0) {
+        nbuckets = strtoul(argv[argi + 1], NULL, 10);
+        argi += 2;
+    }
+    if (argi + 1 != argc || (nbuckets & (nbuckets - 1)) != 0) {
+        fprintf(stderr, "usage: %s [-b BUCKETS] IMAGE (BUCKETS a power of two)\n", argv[0]);
+        return 2;
+    }
+
+    f = fopen(argv[argi], "r+b");
+    if (f == NULL) {
+        perror(argv[argi]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    img.size = ftell(f);
+    rewind(f);
+    img.data = malloc(img.size);
+    if (img.data == NULL || fread(img.data, 1, img.size, f) != img.size) {
+        fprintf(stderr, "%s: can't read the image\n", argv[argi]);
+        return 1;
+    }
+
+    img.sb = (struct ktfs_superblock*)img.data;
+    img.bitmap_start = 1 + img.sb->inode_bitmap_block_count;
+    img.inode_start = img.bitmap_start + img.sb->bitmap_block_count;
+    img.data_start = img.inode_start + img.sb->inode_block_count;
+    img.ndata = img.sb->block_count - img.data_start;
+    if ((long)img.sb->block_count * KTFS_BLKSZ > img.size || img.data_start >= img.sb->block_count) {
+        fprintf(stderr, "%s: not a KTFS image\n", argv[argi]);
+        return 1;
+    }
+    if (img.sb->features & KTFS_FEATURE_HASHDIR) {
+        fprintf(stderr, "%s: root directory is already hashed\n", argv[argi]);
+        return 1;
+    }
+
+    max_inodes = img.sb->inode_block_count * KTFS_NUM_INODES_IN_BLOCK;
+    if (nbuckets == 0) {
+        nbuckets = 1;
+        while (nbuckets * KTFS_NUM_DENTRY_IN_BLOCK < 2 * max_inodes) nbuckets *= 2;
+    }
+    root = (struct ktfs_inode*)(img.data + img.inode_start * KTFS_BLKSZ) + img.sb->root_directory_inode;
+    nfiles = root->size / KTFS_DENSZ;
+    if (nfiles > nbuckets * KTFS_NUM_DENTRY_IN_BLOCK || (uint64_t)nbuckets * KTFS_BLKSZ > KTFS_MAX_FILE_SIZE) {
+        fprintf(stderr, "%u buckets can't hold %u files\n", nbuckets, nfiles);
+        return 1;
+    }
+
+    // Take the dentries out, give the old blocks back, and lay the new ones out in their place
+
+    dents = malloc((nfiles + 1) * sizeof(struct ktfs_dir_entry));
+    for (uint32_t i = 0; i < nfiles; i++)
+        memcpy(&dents[i],
+               (struct ktfs_dir_entry*)block(&img, *file_block(&img, root, i / KTFS_NUM_DENTRY_IN_BLOCK)) +
+                   i % KTFS_NUM_DENTRY_IN_BLOCK,
+               KTFS_DENSZ);
+    free_file_blocks(&img, root);
+    if (alloc_dir(&img, root, nbuckets) < 0) {
+        fprintf(stderr, "not enough free blocks for %u buckets\n", nbuckets);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < nfiles; i++) {
+        unsigned int hash = ktfs_name_hash(dents[i].name);
+        uint32_t n;
+
+        for (n = 0; n < nbuckets; n++) {
+            struct ktfs_dir_entry* bucket =
+                block(&img, *file_block(&img, root, (hash + n) & (nbuckets - 1)));
+            int j = 0;
+
+            while (j < KTFS_NUM_DENTRY_IN_BLOCK && bucket[j].name[0] != '\0') j++;
+            if (j < KTFS_NUM_DENTRY_IN_BLOCK) {
+                memcpy(&bucket[j], &dents[i], KTFS_DENSZ);
+                break;
+            }
+        }
+        if (n > 0) printf("%.*s is %u blocks past its own\n", (int)(KTFS_MAX_FILENAME_LEN), dents[i].name, n);
+    }
+
+    img.sb->features |= KTFS_FEATURE_HASHDIR;
+    img.sb->dir_bucket_count = nbuckets;
+
+    rewind(f);
+    if (fwrite(img.data, 1, img.size, f) != img.size || fclose(f) != 0) {
+        perror(argv[argi]);
+        return 1;
+    }
+    printf("%u files in %u buckets (room for %u)\n", nfiles, nbuckets, nbuckets * KTFS_NUM_DENTRY_IN_BLOCK);
+    return 0;
+}
+
+// INTERNAL FUNCTION DEFINITIONS
+//
+
+/**
+ * @brief finds a data block in the image
+ * @param img the image
+ * @param db data block index, relative to the start of the data blocks as in an inode
+ * @return the block
+ */
+static void* block(struct image* img, uint32_t db) {
+    return img->data + (uint64_t)(img->data_start + db) * KTFS_BLKSZ;
+}
+
+/**
+ * @brief finds the entry that maps a block of a file, going through its indirect blocks
+ * @param img the image
+ * @param inode the file
+ * @param idx block of the file
+ * @return the entry (in the inode, or in an indirect block)
+ */
+static uint32_t* file_block(struct image* img, struct ktfs_inode* inode, uint32_t idx) {
+    uint32_t* lvl_one;
+
+    if (idx < KTFS_NUM_DIRECT_DATA_BLOCKS) return &inode->block[idx];
+    idx -= KTFS_NUM_DIRECT_DATA_BLOCKS;
+    if (idx < PTRS_PER_BLK) return (uint32_t*)block(img, inode->indirect) + idx;
+    idx -= PTRS_PER_BLK;
+    lvl_one = block(img, inode->dindirect[idx / (PTRS_PER_BLK * PTRS_PER_BLK)]);
+    idx %= PTRS_PER_BLK * PTRS_PER_BLK;
+    return (uint32_t*)block(img, lvl_one[idx / PTRS_PER_BLK]) + idx % PTRS_PER_BLK;
+}
+
+/**
+ * @brief marks a data block free in the bitmap
+ * @param img the image
+ * @param db data block index
+ */
+static void free_db(struct image* img, uint32_t db) {
+    img->data[img->bitmap_start * KTFS_BLKSZ + db / 8] &= ~(1 << (db % 8));
+}
+
+/**
+ * @brief claims the first run of n free data blocks in the bitmap
+ * @param img the image
+ * @param n blocks in the run
+ * @param first set to the first block of the run
+ * @return 0 on success, -1 if there's no such run
+ */
+static int claim_run(struct image* img, uint32_t n, uint32_t* first) {
+    unsigned char* bitmap = img->data + img->bitmap_start * KTFS_BLKSZ;
+    uint32_t len = 0;
+
+    for (uint32_t db = 0; db < img->ndata; db++) {
+        len = (bitmap[db / 8] & (1 << (db % 8))) ? 0 : len + 1;
+        if (len == n) {
+            *first = db + 1 - n;
+            for (uint32_t i = *first; i <= db; i++) bitmap[i / 8] |= 1 << (i % 8);
+            memset(block(img, *first), 0, (size_t)n * KTFS_BLKSZ);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief frees a file's data blocks and indirect blocks in the bitmap, as ktfs_free_file_blocks does
+ * @param img the image
+ * @param inode the file
+ */
+static void free_file_blocks(struct image* img, struct ktfs_inode* inode) {
+    uint32_t nblks = (inode->size + KTFS_BLKSZ - 1) / KTFS_BLKSZ;
+
+    for (uint32_t i = 0; i < nblks; i++) free_db(img, *file_block(img, inode, i));
+    if (nblks > KTFS_NUM_DIRECT_DATA_BLOCKS) free_db(img, inode->indirect);
+    if (nblks <= KTFS_NUM_DIRECT_DATA_BLOCKS + PTRS_PER_BLK) return;
+    nblks -= KTFS_NUM_DIRECT_DATA_BLOCKS + PTRS_PER_BLK;
+    for (uint32_t d = 0; d * PTRS_PER_BLK * PTRS_PER_BLK < nblks; d++) {
+        uint32_t* lvl_one = block(img, inode->dindirect[d]);
+        uint32_t nleaves = nblks - d * PTRS_PER_BLK * PTRS_PER_BLK;
+
+        if (nleaves > PTRS_PER_BLK * PTRS_PER_BLK) nleaves = PTRS_PER_BLK * PTRS_PER_BLK;
+        for (uint32_t j = 0; j < (nleaves + PTRS_PER_BLK - 1) / PTRS_PER_BLK; j++) free_db(img, lvl_one[j]);
+        free_db(img, inode->dindirect[d]);
+    }
+}
+
+/**
+ * @brief gives the root directory nbuckets zeroed blocks in one run, with the indirect blocks to map them
+ * @param img the image
+ * @param inode the root directory
+ * @param nbuckets blocks it gets
+ * @return 0 on success, -1 if there aren't the free blocks
+ */
+static int alloc_dir(struct image* img, struct ktfs_inode* inode, uint32_t nbuckets) {
+    uint32_t first, idx;
+
+    memset(inode, 0, sizeof(*inode));
+    inode->size = nbuckets * KTFS_BLKSZ;
+    if (nbuckets > KTFS_NUM_DIRECT_DATA_BLOCKS && claim_run(img, 1, &inode->indirect) < 0) return -1;
+    for (uint32_t d = 0; d < KTFS_NUM_DINDIRECT_BLOCKS; d++) {
+        uint32_t base = KTFS_NUM_DIRECT_DATA_BLOCKS + PTRS_PER_BLK + d * PTRS_PER_BLK * PTRS_PER_BLK;
+        uint32_t* lvl_one;
+
+        if (nbuckets <= base) break;
+        if (claim_run(img, 1, &inode->dindirect[d]) < 0) return -1;
+        lvl_one = block(img, inode->dindirect[d]);
+        for (uint32_t j = 0; j * PTRS_PER_BLK < nbuckets - base && j < PTRS_PER_BLK; j++)
+            if (claim_run(img, 1, &lvl_one[j]) < 0) return -1;
+    }
+
+    if (claim_run(img, nbuckets, &first) < 0) return -1;
+    for (idx = 0; idx < nbuckets; idx++) *file_block(img, inode, idx) = first + idx;
+    return 0;
+}